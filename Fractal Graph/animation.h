@@ -0,0 +1,355 @@
+#pragma once
+//Animation mode: renders a zoom sequence between keyframes and streams the frames out as Y4M or PPM
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "render.h"
+#include "tiles.h"
+
+//One line of a keyframe file: "<frame> <center_re> <center_im> <width> <start_re> <start_im> <palette_offset>"
+struct keyframe {
+	long long frame;
+	clong_double center;
+	//Width of the view in the plane; height follows from the image's aspect ratio
+	long double width;
+	clong_double starting_point;
+	long double palette_offset;
+};
+
+//Read keyframes from a text file, skipping blank lines and '#' comments; they must be in frame order.
+//Trailing columns may be left off, in which case the starting point comes from base and the offset is 0.
+bool load_keyframes(const std::string& path, const fractal_view& base, std::vector<keyframe>& keys) {
+	FILE* file = open_file(path, "r");
+	if (!file)
+		return false;
+	char line[1024];
+	while (fgets(line, sizeof(line), file)) {
+		const char* pos = line;
+		while (*pos == ' ' || *pos == '\t')
+			++pos;
+		if (*pos == '#' || *pos == '\n' || *pos == '\r' || *pos == '\0')
+			continue;
+		char* end;
+		keyframe key;
+		key.frame = strtoll(pos, &end, 10);
+		long double values[6];
+		int k = 0;
+		for (pos = end; k < 6; ++k, pos = end) {
+			values[k] = strtold(pos, &end);
+			if (end == pos)
+				break;
+		}
+		if (k < 3 || (!keys.empty() && key.frame <= keys.back().frame) || values[2] <= 0.0) {
+			fclose(file);
+			return false;
+		}
+		key.center = clong_double(values[0], values[1]);
+		key.width = values[2];
+		key.starting_point = (k > 4) ? clong_double(values[3], values[4]) : base.starting_point;
+		key.palette_offset = (k > 5) ? values[5] : 0.0;
+		keys.push_back(key);
+	}
+	fclose(file);
+	return !keys.empty();
+}
+
+//The view and palette offset at a given frame. Width moves exponentially, and the center moves in step
+//with it so that the point being zoomed toward stays put on screen instead of drifting.
+fractal_view interpolate_keyframes(const std::vector<keyframe>& keys, long long frame, long double aspect, const fractal_view& base, long double& palette_offset) {
+	std::size_t k = 0;
+	while (k + 2 < keys.size() && keys[k + 1].frame <= frame)
+		++k;
+	const keyframe& a = keys[k];
+	const keyframe& b = keys[std::min(k + 1, keys.size() - 1)];
+	long double t = (b.frame == a.frame) ? 0.0 : static_cast<long double>(frame - a.frame) / static_cast<long double>(b.frame - a.frame);
+	t = std::max<long double>(0.0, std::min<long double>(1.0, t));
+	long double width = a.width * powl(b.width / a.width, t);
+	long double along = (a.width == b.width) ? t : (a.width - width) / (a.width - b.width);
+	long double x = a.center.real + (b.center.real - a.center.real) * along;
+	long double y = a.center.imaginary + (b.center.imaginary - a.center.imaginary) * along;
+	fractal_view view = base;
+	view.xmin = x - width / 2.0;
+	view.xmax = x + width / 2.0;
+	view.ymin = y - width * aspect / 2.0;
+	view.ymax = y + width * aspect / 2.0;
+	view.starting_point = clong_double(
+		a.starting_point.real + (b.starting_point.real - a.starting_point.real) * t,
+		a.starting_point.imaginary + (b.starting_point.imaginary - a.starting_point.imaginary) * t);
+	palette_offset = a.palette_offset + (b.palette_offset - a.palette_offset) * t;
+	return view;
+}
+
+//Split a one-PPM-per-frame path around its frame number, "%d" or "%0Nd"; false unless that is its only '%'
+bool split_frame_pattern(const std::string& path, std::string& before, std::string& after, int& digits) {
+	std::size_t at = path.find('%');
+	if (at == std::string::npos)
+		return false;
+	std::size_t end = at + 1;
+	digits = 0;
+	if (end < path.size() && path[end] == '0') {
+		++end;
+		while (end < path.size() && path[end] >= '0' && path[end] <= '9' && digits < 100)
+			digits = digits * 10 + (path[end++] - '0');
+		if (digits == 0)
+			return false;
+	}
+	if (end >= path.size() || path[end] != 'd' || path.find('%', end) != std::string::npos)
+		return false;
+	before = path.substr(0, at);
+	after = path.substr(end + 1);
+	return true;
+}
+
+//Where rendered frames go: a Y4M stream, a stream of PPMs, or one PPM file per frame
+class frame_writer {
+public:
+	frame_writer() { file = NULL; width = height = 0; count = 0; digits = 0; y4m = true; }
+	~frame_writer() { close(); }
+	//path "-" means stdout; a path holding one "%d" or "%0Nd", and no other '%', gets one PPM per frame
+	bool open(const std::string& path_, const std::string& format, int width_, int height_, int fps) {
+		path = path_;
+		width = width_;
+		height = height_;
+		y4m = (format == "y4m");
+		if (path.find('%') != std::string::npos) {
+			y4m = false;
+			return split_frame_pattern(path, before, after, digits);
+		}
+		if (path == "-") {
+#ifdef _WIN32
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+			file = stdout;
+		}
+		else
+			file = open_file(path, "wb");
+		if (!file)
+			return false;
+		if (y4m)
+			fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+		return true;
+	}
+	//Append one frame of packed RGB bytes
+	bool write(const unsigned char* rgb) {
+		FILE* dest = file;
+		if (!dest) {
+			char number[128];
+			snprintf(number, sizeof(number), "%0*d", digits, count);
+			dest = open_file(before + number + after, "wb");
+			if (!dest)
+				return false;
+		}
+		std::size_t pixels = static_cast<std::size_t>(width) * height;
+		bool ok;
+		if (y4m) {
+			to_yuv444(rgb, pixels);
+			fputs("FRAME\n", dest);
+			ok = fwrite(&planes[0], 1, planes.size(), dest) == planes.size();
+		}
+		else {
+			fprintf(dest, "P6\n%d %d\n255\n", width, height);
+			ok = fwrite(rgb, 3, pixels, dest) == pixels;
+		}
+		if (dest != file)
+			fclose(dest);
+		else
+			fflush(dest);
+		++count;
+		return ok;
+	}
+	void close() {
+		if (file && file != stdout)
+			fclose(file);
+		file = NULL;
+	}
+private:
+	// REPRESENTATION
+	std::string path;
+	//For one PPM per frame: the path either side of the frame number, and its zero-padded width
+	std::string before;
+	std::string after;
+	int digits;
+	FILE* file;
+	int width;
+	int height;
+	int count;
+	bool y4m;
+	std::vector<unsigned char> planes;
+	//BT.601 studio-range conversion into three full-resolution planes
+	void to_yuv444(const unsigned char* rgb, std::size_t pixels) {
+		planes.resize(pixels * 3);
+		unsigned char* y = &planes[0];
+		unsigned char* u = y + pixels;
+		unsigned char* v = u + pixels;
+		for (std::size_t p = 0; p < pixels; ++p) {
+			int r = rgb[3 * p], g = rgb[3 * p + 1], b = rgb[3 * p + 2];
+			y[p] = static_cast<unsigned char>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+			u[p] = static_cast<unsigned char>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+			v[p] = static_cast<unsigned char>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+		}
+	}
+};
+
+//Lattice levels a zoom is rendered at, every zoom_steps / 8 so eight to the octave. Each frame is drawn from the
+//level at or just finer than its own pixels, so the frames zooming through a level all take its tiles and each
+//tile is computed once for them all.
+const long long animation_level_step = 512;
+
+//The levels a width x height frame of view is drawn from
+void animation_levels(const fractal_view& view, int width, int height, long long& level_x, long long& level_y) {
+	level_x = floor_div(zoom_level(view_width(view) / width), animation_level_step) * animation_level_step;
+	level_y = floor_div(zoom_level(view_height(view) / height), animation_level_step) * animation_level_step;
+}
+
+//Whether two frames would be drawn from the same tiles, so that putting either on the lattice saves work
+bool share_tiles(const fractal_view& a, const fractal_view& b, int width, int height) {
+	long long ax, ay, bx, by;
+	animation_levels(a, width, height, ax, ay);
+	animation_levels(b, width, height, bx, by);
+	return same_fractal(a, b) && ax == bx && ay == by;
+}
+
+//Tiles animation frames keep between them
+const std::size_t animation_cache_bytes = 256u << 20;
+
+//The frame on the lattice at levels (level_x, level_y) that takes in every cell the view touches
+bool cover_with_lattice(const fractal_view& view, long long level_x, long long level_y, lattice_frame& frame) {
+	frame.level_x = level_x;
+	frame.level_y = level_y;
+	frame.pixel_x = level_size(level_x);
+	frame.pixel_y = level_size(level_y);
+	long double x0 = floorl(static_cast<long double>(view.xmin) / frame.pixel_x), x1 = ceill(static_cast<long double>(view.xmax) / frame.pixel_x);
+	long double y0 = floorl(static_cast<long double>(view.ymin) / frame.pixel_y), y1 = ceill(static_cast<long double>(view.ymax) / frame.pixel_y);
+	if (fabsl(x0) > lattice_limit || fabsl(x1) > lattice_limit || fabsl(y0) > lattice_limit || fabsl(y1) > lattice_limit
+		|| x1 - x0 > 1 << 16 || y1 - y0 > 1 << 16)
+		return false;
+	frame.x0 = static_cast<long long>(x0);
+	frame.y0 = static_cast<long long>(y0);
+	frame.width = static_cast<int>(x1 - x0) + 1;
+	frame.height = static_cast<int>(y1 - y0) + 1;
+	return true;
+}
+
+//Fill a width x height frame of view into out from the lattice tiles in cache, computing those it lacks. Each
+//pixel takes the lattice cell its point falls in. Falls back on render_rows where the lattice does not reach.
+//Returns the number of tiles computed, or -1 if it fell back.
+int render_lattice_frame(const fractal_view& view, int width, int height, tile_cache& cache, std::vector<int>& cells, int* out) {
+	long long level_x, level_y;
+	animation_levels(view, width, height, level_x, level_y);
+	lattice_frame frame;
+	if (!cover_with_lattice(view, level_x, level_y, frame)) {
+		render_rows(view, width, height, 0, height, out, render_pool());
+		return -1;
+	}
+	cells.resize(static_cast<std::size_t>(frame.width) * frame.height);
+	int computed = render_tiles(view, frame, cache, &cells[0], render_pool());
+	for (int i = 0; i < height; ++i)
+		for (int j = 0; j < width; ++j) {
+			clong_double dot = pixel_point(view, j, i, width, height);
+			long long a = std::max(0LL, std::min<long long>(frame.width - 1, static_cast<long long>(floorl(dot.real / frame.pixel_x)) - frame.x0));
+			long long b = std::max(0LL, std::min<long long>(frame.height - 1, static_cast<long long>(floorl(dot.imaginary / frame.pixel_y)) - frame.y0));
+			out[static_cast<std::size_t>(i) * width + j] = cells[static_cast<std::size_t>(b) * frame.width + a];
+		}
+	return computed;
+}
+
+//Render every frame of the sequence. Frames that share lattice levels with the frame before or after are drawn
+//from tiles, so a zoom or pan computes only the tiles earlier frames did not; a frame that shares with neither,
+//in a zoom too fast for that, is rendered directly. Frames whose view did not change (holds, palette cycling)
+//are only recolored.
+int render_animation(const std::vector<keyframe>& keys, const fractal_view& base, int width, int height, const gradient& scheme, long double moddenom, frame_writer& out) {
+	std::size_t pixels = static_cast<std::size_t>(width) * height;
+	std::vector<int> iterations(pixels), cells;
+	std::vector<unsigned char> rgb(pixels * 3);
+	std::vector<unsigned char> palette;
+	tile_cache cache(animation_cache_bytes);
+	fractal_view previous;
+	long double previous_offset = 0.0;
+	bool have_previous = false;
+	long long frames = keys.back().frame + 1;
+	long double aspect = static_cast<long double>(height) / static_cast<long double>(width);
+	for (long long f = keys.front().frame; f < frames; ++f) {
+		long double offset;
+		fractal_view view = interpolate_keyframes(keys, f, aspect, base, offset);
+		bool recompute = !have_previous || !same_view(view, previous);
+		int computed = 0;
+		long double next_offset;
+		if (recompute && ((have_previous && share_tiles(view, previous, width, height))
+			|| (f + 1 < frames && share_tiles(view, interpolate_keyframes(keys, f + 1, aspect, base, next_offset), width, height))))
+			computed = render_lattice_frame(view, width, height, cache, cells, &iterations[0]);
+		else if (recompute) {
+			render_rows(view, width, height, 0, height, &iterations[0], render_pool());
+			computed = -1;
+		}
+		if (recompute || offset != previous_offset || palette.empty()) {
+			palette = build_palette(scheme, view.maxiterations, moddenom, offset);
+			colorize(&iterations[0], pixels, palette, &rgb[0]);
+		}
+		if (!out.write(&rgb[0])) {
+			fprintf(stderr, "animate: write failed at frame %lld\n", f);
+			return 1;
+		}
+		previous = view;
+		previous_offset = offset;
+		have_previous = true;
+		if (!recompute)
+			fprintf(stderr, "animate: frame %lld of %lld (reused)\n", f + 1, frames);
+		else if (computed < 0)
+			fprintf(stderr, "animate: frame %lld of %lld (direct)\n", f + 1, frames);
+		else
+			fprintf(stderr, "animate: frame %lld of %lld (%d new tiles)\n", f + 1, frames, computed);
+	}
+	return 0;
+}
+
+//Entry point for "--animate <keyframes.txt> <width> <height> <output|-> [--format=y4m|ppm] [--fps=n] [--scheme=n] [view options]"
+int animation_main(int argc, char** argv, const fractal_view& defaults, const std::vector<gradient>& gradients, long double moddenom) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: --animate <keyframes.txt> <width> <height> <output|-> [--format=y4m|ppm] [--fps=n] [--scheme=n] [--type=n] [--iter=n]\n");
+		return 1;
+	}
+	fractal_view base = defaults;
+	int width = atoi(argv[1]);
+	int height = atoi(argv[2]);
+	std::string path = argv[3];
+	std::string format = (path.size() > 4 && path.compare(path.size() - 4, 4, ".ppm") == 0) ? "ppm" : "y4m";
+	int fps = 30;
+	int scheme = 0;
+	for (int a = 4; a < argc; ++a) {
+		std::string arg = argv[a];
+		if (arg.compare(0, 9, "--format=") == 0)
+			format = arg.substr(9);
+		else if (arg.compare(0, 6, "--fps=") == 0)
+			fps = atoi(arg.c_str() + 6);
+		else if (arg.compare(0, 9, "--scheme=") == 0)
+			scheme = atoi(arg.c_str() + 9);
+		else if (!parse_view_option(arg, base)) {
+			fprintf(stderr, "animate: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	std::vector<keyframe> keys;
+	if (!load_keyframes(argv[0], base, keys)) {
+		fprintf(stderr, "animate: cannot read keyframes from %s\n", argv[0]);
+		return 1;
+	}
+	if (width <= 0 || height <= 0 || fps <= 0 || (format != "y4m" && format != "ppm")) {
+		fprintf(stderr, "animate: bad size, frame rate or format\n");
+		return 1;
+	}
+	frame_writer out;
+	if (!out.open(path, format, width, height, fps)) {
+		fprintf(stderr, "animate: cannot open %s\n", path.c_str());
+		return 1;
+	}
+	return render_animation(keys, base, width, height, gradients[scheme % gradients.size()], moddenom, out);
+}
+
+#endif
@@ -0,0 +1,374 @@
+#pragma once
+//Complex batches: N complex numbers as separate rows of real and imaginary parts, so a kernel can step many
+//orbits at once in vector registers instead of one padded number at a time
+#ifndef __BATCH_H__
+#define __BATCH_H__
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include "complex.h"
+#include "doubledouble.h"
+
+//Lanes in the batches the renderers evaluate points in
+const int batch_lanes = 8;
+
+//Which lanes of a batch an operation applies to
+template <int N>
+struct batch_mask {
+	bool lanes[N];
+	int count() const noexcept {
+		int found = 0;
+		for (int k = 0; k < N; ++k)
+			found += lanes[k];
+		return found;
+	}
+};
+
+//N complex numbers over T, structure of arrays. Every operation is lane by lane in the same order of operations
+//as basic_complex<T>, so a lane gives bit for bit what the scalar code would.
+template <class T, int N>
+struct complex_batch {
+	//Rows are aligned to their own size, up to a cache line, so whole rows load and store as vectors
+	static const std::size_t alignment = (sizeof(T) * N < 64) ? sizeof(T) * N : 64;
+	// REPRESENTATION
+	alignas(alignment) T real[N];
+	alignas(alignment) T imaginary[N];
+
+	static complex_batch broadcast(const basic_complex<T>& value) noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k) {
+			out.real[k] = value.real;
+			out.imaginary[k] = value.imaginary;
+		}
+		return out;
+	}
+	//From rows at addresses aligned like ours
+	static complex_batch load(const T* real_, const T* imaginary_) noexcept {
+		assert(reinterpret_cast<std::uintptr_t>(real_) % alignment == 0 && reinterpret_cast<std::uintptr_t>(imaginary_) % alignment == 0);
+		complex_batch out;
+		for (int k = 0; k < N; ++k) {
+			out.real[k] = real_[k];
+			out.imaginary[k] = imaginary_[k];
+		}
+		return out;
+	}
+	void store(T* real_, T* imaginary_) const noexcept {
+		assert(reinterpret_cast<std::uintptr_t>(real_) % alignment == 0 && reinterpret_cast<std::uintptr_t>(imaginary_) % alignment == 0);
+		for (int k = 0; k < N; ++k) {
+			real_[k] = real[k];
+			imaginary_[k] = imaginary[k];
+		}
+	}
+	basic_complex<T> lane(int k) const noexcept {
+		return basic_complex<T>(real[k], imaginary[k]);
+	}
+	void set_lane(int k, const basic_complex<T>& value) noexcept {
+		real[k] = value.real;
+		imaginary[k] = value.imaginary;
+	}
+	complex_batch operator+ (const complex_batch& other) const noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k) {
+			out.real[k] = real[k] + other.real[k];
+			out.imaginary[k] = imaginary[k] + other.imaginary[k];
+		}
+		return out;
+	}
+	complex_batch operator* (const complex_batch& other) const noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k) {
+			out.real[k] = real[k] * other.real[k] - imaginary[k] * other.imaginary[k];
+			out.imaginary[k] = imaginary[k] * other.real[k] + real[k] * other.imaginary[k];
+		}
+		return out;
+	}
+	//z * z, as the Mandelbrot and quadratic Julia steps take it
+	complex_batch square() const noexcept {
+		return *this * *this;
+	}
+	//z * z * z, as the cubic Julia step takes it
+	complex_batch cube() const noexcept {
+		return square() * *this;
+	}
+	//(|re|, |im|), the burning ship's fold before squaring
+	complex_batch folded() const noexcept {
+		using std::abs;
+		complex_batch out;
+		for (int k = 0; k < N; ++k) {
+			out.real[k] = abs(real[k]);
+			out.imaginary[k] = abs(imaginary[k]);
+		}
+		return out;
+	}
+	void norm(T* out) const noexcept {
+		for (int k = 0; k < N; ++k)
+			out[k] = real[k] * real[k] + imaginary[k] * imaginary[k];
+	}
+	//Set near[k] on the lanes whose squared distance from other's is under limit
+	void mark_near(const complex_batch& other, T limit, bool* near) const noexcept {
+		for (int k = 0; k < N; ++k) {
+			T dr = real[k] - other.real[k], di = imaginary[k] - other.imaginary[k];
+			near[k] |= dr * dr + di * di < limit;
+		}
+	}
+	//Take value's lanes where mask is set and keep ours elsewhere
+	void assign_where(const batch_mask<N>& mask, const complex_batch& value) noexcept {
+		for (int k = 0; k < N; ++k) {
+			real[k] = mask.lanes[k] ? value.real[k] : real[k];
+			imaginary[k] = mask.lanes[k] ? value.imaginary[k] : imaginary[k];
+		}
+	}
+};
+
+//N double-double complex numbers with the high and low words of each part in rows of their own, so every step
+//of the error-free transforms is one operation across plain rows of doubles. Lanes give bit for bit what
+//basic_complex<double_double> would, as in the general batch.
+template <int N>
+struct complex_batch<double_double, N> {
+	static const std::size_t alignment = (sizeof(double) * N < 64) ? sizeof(double) * N : 64;
+	// REPRESENTATION
+	alignas(alignment) double real_hi[N];
+	alignas(alignment) double real_lo[N];
+	alignas(alignment) double imaginary_hi[N];
+	alignas(alignment) double imaginary_lo[N];
+
+	static complex_batch broadcast(const cdouble_double& value) noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k)
+			out.set_lane(k, value);
+		return out;
+	}
+	double_double real(int k) const noexcept {
+		return double_double(real_hi[k], real_lo[k]);
+	}
+	double_double imaginary(int k) const noexcept {
+		return double_double(imaginary_hi[k], imaginary_lo[k]);
+	}
+	cdouble_double lane(int k) const noexcept {
+		return cdouble_double(real(k), imaginary(k));
+	}
+	void set_lane(int k, const cdouble_double& value) noexcept {
+		real_hi[k] = value.real.hi;
+		real_lo[k] = value.real.lo;
+		imaginary_hi[k] = value.imaginary.hi;
+		imaginary_lo[k] = value.imaginary.lo;
+	}
+	complex_batch operator+ (const complex_batch& other) const noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k)
+			out.set_lane(k, cdouble_double(real(k) + other.real(k), imaginary(k) + other.imaginary(k)));
+		return out;
+	}
+	complex_batch operator* (const complex_batch& other) const noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k)
+			out.set_lane(k, cdouble_double(real(k) * other.real(k) - imaginary(k) * other.imaginary(k),
+				imaginary(k) * other.real(k) + real(k) * other.imaginary(k)));
+		return out;
+	}
+	complex_batch square() const noexcept {
+		return *this * *this;
+	}
+	complex_batch cube() const noexcept {
+		return square() * *this;
+	}
+	complex_batch folded() const noexcept {
+		complex_batch out;
+		for (int k = 0; k < N; ++k)
+			out.set_lane(k, cdouble_double(abs(real(k)), abs(imaginary(k))));
+		return out;
+	}
+	void norm(double_double* out) const noexcept {
+		for (int k = 0; k < N; ++k)
+			out[k] = real(k) * real(k) + imaginary(k) * imaginary(k);
+	}
+	void mark_near(const complex_batch& other, const double_double& limit, bool* near) const noexcept {
+		for (int k = 0; k < N; ++k) {
+			double_double dr = real(k) - other.real(k), di = imaginary(k) - other.imaginary(k);
+			near[k] |= dr * dr + di * di < limit;
+		}
+	}
+	void assign_where(const batch_mask<N>& mask, const complex_batch& value) noexcept {
+		for (int k = 0; k < N; ++k) {
+			real_hi[k] = mask.lanes[k] ? value.real_hi[k] : real_hi[k];
+			real_lo[k] = mask.lanes[k] ? value.real_lo[k] : real_lo[k];
+			imaginary_hi[k] = mask.lanes[k] ? value.imaginary_hi[k] : imaginary_hi[k];
+			imaginary_lo[k] = mask.lanes[k] ? value.imaginary_lo[k] : imaginary_lo[k];
+		}
+	}
+};
+
+//One step of the map of fractal type (0 to 3) on every lane, k being the constant added
+template <class T, int N>
+complex_batch<T, N> step_batch(int type, const complex_batch<T, N>& z, const complex_batch<T, N>& k) noexcept {
+	switch (type) {
+	case 1:
+		return z.folded().square() + k;
+	case 3:
+		return z.cube() + k;
+	}
+	return z.square() + k;
+}
+
+//The same step for one point, in the same order of operations as a lane of step_batch
+template <class T>
+basic_complex<T> step_point(int type, const basic_complex<T>& z, const basic_complex<T>& k) noexcept {
+	using std::abs;
+	switch (type) {
+	case 1: {
+		basic_complex<T> folded(abs(z.real), abs(z.imaginary));
+		return folded * folded + k;
+	}
+	case 3:
+		return z * z * z + k;
+	}
+	return z * z + k;
+}
+
+//How full escape_stream kept its lanes: of all the lane steps its chunks took, how many were on a live pixel
+struct stream_usage {
+	long long busy;
+	long long total;
+};
+
+//escape() for count points, results[p] (and last, period and inside, where given) exactly as escape(type, start,
+//points[p], threshold, depth, ..., tolerance) gives them, but through N lanes that never wait on each other. Each
+//lane carries its own pixel, with how many steps that pixel has taken and its own cycle-finding schedule, so
+//lanes run chunks of escape_chunk steps together whatever step their pixels are at. Between chunks a lane whose
+//pixel is done takes the next one from the worklist, and the batch stays full until the worklist runs dry. A
+//lane whose chunk left the escape radius or came near its saved point is rolled back and finishes the chunk
+//alone a step at a time, as is a pixel with fewer than a chunk of steps left or a constant outside the radius.
+template <class T, int N>
+void escape_stream(int type, const basic_complex<T>& start, const basic_complex<T>* points, int count, T threshold, int depth,
+	std::pair<bool, int>* results, basic_complex<T>* last = NULL, int* period = NULL, long double* inside = NULL, long double tolerance = 0.0,
+	stream_usage* usage = NULL) {
+	type %= 4;
+	bool julia = type >= 2;
+	T limit = threshold * threshold;
+	bool detect = period != NULL && tolerance > 0 && type != 1;
+	T near_limit = static_cast<T>(tolerance);
+	complex_batch<T, N> z = complex_batch<T, N>::broadcast(start), k = z, saved = z;
+	//Per lane: the pixel it holds or -1, that pixel's steps so far, its cycle-finding schedule, and whether its
+	//constant lets it take chunks
+	int pixel[N], offset[N], saved_at[N], next_save[N];
+	bool chunkable[N];
+	for (int lane = 0; lane < N; ++lane)
+		pixel[lane] = -1;
+	int next = 0;
+	//Write out the lane's pixel and free the lane
+	auto finish = [&](int lane, bool caught) {
+		basic_complex<T> orbit = z.lane(lane);
+		T norm = orbit.norm();
+		bool escaped = !caught && (julia ? norm > limit : norm >= limit);
+		results[pixel[lane]] = escaped ? std::make_pair(true, depth - offset[lane]) : std::make_pair(false, 0);
+		if (last)
+			last[pixel[lane]] = orbit;
+		pixel[lane] = -1;
+	};
+	//Step the lane's pixel alone, testing every step, up to stop steps, finishing it if it is done
+	auto single = [&](int lane, int stop) {
+		basic_complex<T> orbit = z.lane(lane), constant = k.lane(lane), back = saved.lane(lane);
+		while (orbit.norm() < limit && offset[lane] < stop) {
+			orbit = step_point(type, orbit, constant);
+			++offset[lane];
+			if (!detect)
+				continue;
+			T dr = orbit.real - back.real, di = orbit.imaginary - back.imaginary;
+			if (dr * dr + di * di < near_limit) {
+				clong_double wide(static_cast<long double>(orbit.real), static_cast<long double>(orbit.imaginary));
+				clong_double wide_constant(static_cast<long double>(constant.real), static_cast<long double>(constant.imaginary));
+				int cycle = shortest_period(type, wide, wide_constant, offset[lane] - saved_at[lane], tolerance);
+				long double distance;
+				if (attracting_cycle(type, wide, wide_constant, cycle, distance)) {
+					z.set_lane(lane, orbit);
+					period[pixel[lane]] = cycle;
+					if (inside)
+						inside[pixel[lane]] = distance;
+					finish(lane, true);
+					return;
+				}
+			}
+			if (offset[lane] == next_save[lane]) {
+				back = orbit;
+				saved_at[lane] = offset[lane];
+				next_save[lane] *= 2;
+			}
+		}
+		z.set_lane(lane, orbit);
+		saved.set_lane(lane, back);
+		if (!(orbit.norm() < limit) || offset[lane] == depth)
+			finish(lane, false);
+	};
+	for (;;) {
+		//Refill free lanes; a pixel that is done before its first step never holds one for a chunk
+		for (int lane = 0; lane < N; ++lane)
+			while (pixel[lane] < 0 && next < count) {
+				pixel[lane] = next;
+				z.set_lane(lane, julia ? points[next] : start);
+				k.set_lane(lane, julia ? start : points[next]);
+				saved.set_lane(lane, z.lane(lane));
+				offset[lane] = saved_at[lane] = 0;
+				next_save[lane] = 8;
+				chunkable[lane] = threshold >= 2 && k.lane(lane).norm() <= limit;
+				if (period)
+					period[next] = 0;
+				++next;
+				if (!(z.lane(lane).norm() < limit) || depth == 0)
+					finish(lane, false);
+			}
+		batch_mask<N> fast;
+		bool any = false, idle = true;
+		for (int lane = 0; lane < N; ++lane) {
+			fast.lanes[lane] = pixel[lane] >= 0 && chunkable[lane] && offset[lane] + escape_chunk <= depth;
+			any |= fast.lanes[lane];
+			idle &= pixel[lane] < 0;
+		}
+		if (idle)
+			break;
+		bool near[N], rolled[N];
+		for (int lane = 0; lane < N; ++lane)
+			near[lane] = rolled[lane] = false;
+		if (any) {
+			complex_batch<T, N> snapshot = z;
+			for (int s = 0; s < escape_chunk; ++s) {
+				z.assign_where(fast, step_batch(type, z, k));
+				if (detect)
+					z.mark_near(saved, near_limit, near);
+			}
+			T norms[N];
+			z.norm(norms);
+			for (int lane = 0; lane < N; ++lane) {
+				if (!fast.lanes[lane])
+					continue;
+				if (near[lane] || !(norms[lane] < limit)) {
+					z.set_lane(lane, snapshot.lane(lane));
+					rolled[lane] = true;
+					continue;
+				}
+				offset[lane] += escape_chunk;
+				if (detect && offset[lane] == next_save[lane]) {
+					saved.set_lane(lane, z.lane(lane));
+					saved_at[lane] = offset[lane];
+					next_save[lane] *= 2;
+				}
+			}
+			if (usage) {
+				usage->busy += static_cast<long long>(escape_chunk) * fast.count();
+				usage->total += static_cast<long long>(escape_chunk) * N;
+			}
+		}
+		//Lanes rolled back, near their end or never chunked go a step at a time
+		for (int lane = 0; lane < N; ++lane) {
+			if (pixel[lane] < 0)
+				continue;
+			if (rolled[lane])
+				single(lane, offset[lane] + escape_chunk);
+			else if (!fast.lanes[lane])
+				single(lane, chunkable[lane] ? std::min(offset[lane] + escape_chunk, depth) : depth);
+		}
+	}
+}
+
+#endif
@@ -2,113 +2,135 @@
 //Defines classes and functions for complex mathematics
 #ifndef __COMPLEX_VARIABLES_H__
 #define __COMPLEX_VARIABLES_H__
+#include <cmath>
 #include <iostream>
 #include <utility>
 
-//Colmpex long doubleing-point numer
-class clong_double {
+//Complex number over any real type T with the usual arithmetic: float, double, long double, or a custom type
+//such as a double-double. Everything is constexpr and noexcept where T allows, so kernels can inline it.
+template <class T>
+class basic_complex {
 public:
+	typedef T value_type;
 	// REPRESENTATION
-	long double real;
-	long double imaginary;
+	T real;
+	T imaginary;
 	// Default constructor
-	clong_double() { real = 0.0; imaginary = 0.0; }
+	constexpr basic_complex() noexcept : real(0), imaginary(0) {}
 	//Another constructor
-	clong_double(long double real_, long double imaginary_) {
-		real = real_; imaginary = imaginary_;
-	}
-	//Construct from a long double
-	clong_double(long double real_) { real = real_; imaginary = 0.0; }
-	friend std::ostream& operator<< (std::ostream dest, const clong_double& num) {
-		dest << num.real << " + " << num.imaginary << "i ";
+	constexpr basic_complex(T real_, T imaginary_) noexcept : real(real_), imaginary(imaginary_) {}
+	//Construct from a real
+	constexpr basic_complex(T real_) noexcept : real(real_), imaginary(0) {}
+	//From another precision
+	template <class U>
+	constexpr explicit basic_complex(const basic_complex<U>& other) noexcept : real(static_cast<T>(other.real)), imaginary(static_cast<T>(other.imaginary)) {}
+	friend std::ostream& operator<< (std::ostream& dest, const basic_complex& num) {
+		return dest << num.real << " + " << num.imaginary << "i ";
 	}
 	//Operators
-	clong_double operator= (const clong_double& other) {
-		real = other.real;
-		imaginary = other.imaginary;
-		return *this;
+	constexpr basic_complex operator+ (const basic_complex& other) const noexcept {
+		return basic_complex(real + other.real, imaginary + other.imaginary);
+	}
+	constexpr basic_complex operator+ (T other) const noexcept {
+		return basic_complex(real + other, imaginary);
 	}
-	clong_double operator+ (const clong_double& other) const {
-		return clong_double(real + other.real, imaginary + other.imaginary);
+	constexpr basic_complex operator- (const basic_complex& other) const noexcept {
+		return basic_complex(real - other.real, imaginary - other.imaginary);
 	}
-	clong_double operator+ (long double other) const {
-		return clong_double(real + other, imaginary);
+	constexpr basic_complex operator- (T other) const noexcept {
+		return basic_complex(real - other, imaginary);
 	}
-	clong_double operator- (const clong_double& other) const {
-		return clong_double(real - other.real, imaginary + other.imaginary);
+	constexpr basic_complex operator- () const noexcept {
+		return basic_complex(-real, -imaginary);
 	}
-	clong_double operator- (long double other) const {
-		return clong_double(real - other, imaginary);
+	constexpr basic_complex operator* (const basic_complex& other) const noexcept {
+		return basic_complex(real * other.real - imaginary * other.imaginary, imaginary * other.real + real * other.imaginary);
 	}
-	clong_double operator* (const clong_double& other) const {
-		return clong_double(real * other.real - imaginary * other.imaginary, imaginary * other.real + real * other.imaginary);
+	constexpr basic_complex operator* (T other) const noexcept {
+		return basic_complex(real * other, imaginary * other);
 	}
-	clong_double operator* (long double other) const {
-		return clong_double(real * other, imaginary * other);
+	constexpr basic_complex operator/ (const basic_complex& other) const noexcept {
+		return (*this * other.conjugate()) / other.norm();
 	}
-	friend clong_double operator/ (long double other, const clong_double& complex) {
-		long double denom = complex.real * complex.real + complex.imaginary + complex.imaginary;
-		return (clong_double(complex.real / denom, -complex.imaginary / denom) * other);
+	constexpr basic_complex operator/ (T other) const noexcept {
+		return basic_complex(real / other, imaginary / other);
 	}
-	friend clong_double operator* (long double other, const clong_double& complex) {
+	friend constexpr basic_complex operator/ (T other, const basic_complex& complex) noexcept {
+		return complex.conjugate() * (other / complex.norm());
+	}
+	friend constexpr basic_complex operator* (T other, const basic_complex& complex) noexcept {
 		return complex * other;
 	}
-	friend clong_double operator+ (long double other, const clong_double& complex) {
+	friend constexpr basic_complex operator+ (T other, const basic_complex& complex) noexcept {
 		return complex + other;
 	}
-	friend clong_double operator- (long double other, const clong_double& complex) {
-		return clong_double(other - complex.real, -complex.imaginary);
+	friend constexpr basic_complex operator- (T other, const basic_complex& complex) noexcept {
+		return basic_complex(other - complex.real, -complex.imaginary);
 	}
-	clong_double operator/ (long double other) const {
-		return clong_double(real / other, imaginary / other);
+	basic_complex& operator+= (const basic_complex& other) noexcept {
+		return *this = *this + other;
 	}
-	clong_double operator+= (long double other) {
-		*this = *this + other;
-		return *this;
+	basic_complex& operator-= (const basic_complex& other) noexcept {
+		return *this = *this - other;
 	}
-	clong_double operator+= (clong_double other) {
-		*this = *this + other;
-		return *this;
+	basic_complex& operator*= (const basic_complex& other) noexcept {
+		return *this = *this * other;
 	}
-	clong_double operator-= (long double other) {
-		*this = *this - other;
-		return *this;
+	basic_complex& operator/= (const basic_complex& other) noexcept {
+		return *this = *this / other;
 	}
-	clong_double operator-= (clong_double other) {
-		*this = *this - other;
+	basic_complex& operator+= (T other) noexcept {
+		real += other;
 		return *this;
 	}
-	clong_double operator/= (long double other) {
-		*this = *this / other;
+	basic_complex& operator-= (T other) noexcept {
+		real -= other;
 		return *this;
 	}
-	clong_double operator*= (long double other) {
-		*this = *this * other;
-		return *this;
+	basic_complex& operator*= (T other) noexcept {
+		return *this = *this * other;
 	}
-	clong_double operator*= (clong_double other) {
-		*this = *this * other;
-		return *this;
+	basic_complex& operator/= (T other) noexcept {
+		return *this = *this / other;
+	}
+	constexpr bool operator== (const basic_complex& other) const noexcept {
+		return real == other.real && imaginary == other.imaginary;
 	}
-	bool operator== (long double other) const {
-		return (real == other && imaginary == 0.0);
+	constexpr bool operator!= (const basic_complex& other) const noexcept {
+		return !(*this == other);
 	}
-	friend bool operator== (long double other, const clong_double& complex) {
+	constexpr bool operator== (T other) const noexcept {
+		return (real == other && imaginary == 0);
+	}
+	friend constexpr bool operator== (T other, const basic_complex& complex) noexcept {
 		return complex == other;
 	}
-	clong_double& operator= (long double other) {
+	basic_complex& operator= (T other) noexcept {
 		real = other;
-		imaginary = 0.0;
+		imaginary = 0;
 		return *this;
 	}
-	long double magnitude() const {
-		return sqrt(real * real + imaginary * imaginary);
+	constexpr basic_complex conjugate() const noexcept {
+		return basic_complex(real, -imaginary);
+	}
+	//Squared magnitude: what bailout tests should compare against the squared radius, without a square root
+	constexpr T norm() const noexcept {
+		return real * real + imaginary * imaginary;
+	}
+	T magnitude() const {
+		using std::sqrt;
+		return sqrt(norm());
 	}
-	long double angle() const {
+	T angle() const {
+		using std::atan2;
 		return atan2(imaginary, real);
 	}
 };
 
+typedef basic_complex<float> cfloat;
+typedef basic_complex<double> cdouble;
+typedef basic_complex<long double> clong_double;
+
 //Checks if a given complex number is part of the julia set for a given function (approximately and recursively)
 std::pair<bool, int> is_lace(clong_double(*func)(clong_double), clong_double arg, long double threshold, int depth) {
 	//Test for convergence approximately (not airtight by any means)
@@ -120,41 +142,174 @@ std::pair<bool, int> is_lace(clong_double(*func)(clong_double), clong_double arg
 	return is_lace(func, func(arg), threshold, depth - 1);
 }
 
-//Evaluate a complex fractal plot value for a given complex number
-std::pair<bool, int> mandelbrot(clong_double arg, clong_double c, long double threshold, int depth) {
+//Whether an orbit at z that seems to repeat every period steps of z^2 + k (types 0 and 2) or z^3 + k (type 3)
+//has been caught by an attracting cycle, the derivative of the period-fold map there being less than 1 in size.
+//For the Mandelbrot set distance then receives an estimate of how far k is from the boundary, otherwise 0.
+bool attracting_cycle(int type, clong_double z, const clong_double& k, int period, long double& distance) {
+	//First derivatives by z and by k, and second derivatives by z twice and by k then z
+	clong_double dz(1.0, 0.0), dc(0.0, 0.0), dzdz(0.0, 0.0), dcdz(0.0, 0.0);
+	for (int n = 0; n < period; ++n) {
+		clong_double slope = (type == 3) ? 3.0 * (z * z) : 2.0 * z;
+		clong_double bend = (type == 3) ? 6.0 * z : clong_double(2.0, 0.0);
+		dzdz = bend * dz * dz + slope * dzdz;
+		dcdz = bend * dz * dc + slope * dcdz;
+		dc = slope * dc + 1.0;
+		dz = slope * dz;
+		z = (type == 3) ? z * z * z + k : z * z + k;
+	}
+	long double size = dz.magnitude();
+	if (!(size < 1.0))
+		return false;
+	distance = 0.0;
+	if (type == 0) {
+		//(1 - |dz|^2) / |dcdz + dzdz dc / (1 - dz)|
+		clong_double away = 1.0 - dz;
+		long double denom = away.real * away.real + away.imaginary * away.imaginary;
+		clong_double bottom = dcdz + dzdz * dc * clong_double(away.real / denom, -away.imaginary / denom);
+		distance = (1.0 - size * size) / bottom.magnitude();
+	}
+	return true;
+}
+
+//Fraction of a pixel an orbit must come back within to be tested for having been caught by a cycle
+const long double cycle_pixel_fraction = 1.0 / 1024;
+
+//Squared distance within which an orbit counts as back where it was, for points pixel apart. It shrinks with the
+//pixels, so at deep zooms an exterior orbit that only lingers near a cycle, its multiplier within rounding of 1,
+//is not mistaken for caught; and it is never more than 1e-20, the tolerance shallow views were checked against.
+long double cycle_tolerance(long double pixel) {
+	long double fine = pixel * cycle_pixel_fraction;
+	return std::min(1e-20L, fine * fine);
+}
+
+//The fewest steps of z^2 + k or z^3 + k after which z comes back within tolerance of itself, given that steps does
+int shortest_period(int type, const clong_double& z, const clong_double& k, int steps, long double tolerance) {
+	clong_double w = z;
+	for (int n = 1; n < steps; ++n) {
+		w = (type == 3) ? w * w * w + k : w * w + k;
+		long double dr = w.real - z.real, di = w.imaginary - z.imaginary;
+		if (dr * dr + di * di < tolerance)
+			return n;
+	}
+	return steps;
+}
+
+
+//One step of the map of fractal type (0 to 3) on the orbit point z, k being the constant added
+void escape_step(int type, clong_double& z, const clong_double& k) {
+	switch (type) {
+	case 0: //Mandelbrot
+	case 2: //Julia for z^2 + c
+		z = z * z + k;
+		break;
+	case 1: //Burning ship
+		z = clong_double(abs(z.real), abs(z.imaginary)) * clong_double(abs(z.real), abs(z.imaginary)) + k;
+		break;
+	case 3:
+		z = z * z * z + k;
+	}
+}
+
+//Steps escape() takes between bailout tests where it may
+const int escape_chunk = 8;
+
+//Evaluate a complex fractal plot value for a given complex number, for an explicit fractal type
+//If last is given it receives the final value of the orbit, for smooth coloring
+//If period and a tolerance (cycle_tolerance of the pixel size) are given, orbits caught by an attracting cycle
+//stop early as interior, with the cycle's period in period (0 for interior points not caught that way) and, if
+//inside is given, the interior distance in it
+std::pair<bool, int> escape(int type, clong_double arg, clong_double c, long double threshold, int depth, clong_double* last = NULL,
+	int* period = NULL, long double* inside = NULL, long double tolerance = 0.0) {
 	std::size_t i = 0;
-	while ( ( (arg.magnitude() < threshold && fractal_type % 4 < 2) || (fractal_type % 4 >= 2 && c.magnitude() < threshold)) && i < depth) {
-		switch (fractal_type % 4) {
-		case 0: //Mandelbrot
-			arg = arg * arg + c;
-			break;
-		case 1: //Burning ship
-			arg = clong_double(abs(arg.real), abs(arg.imaginary)) * clong_double(abs(arg.real), abs(arg.imaginary)) + c;
-			break;
-		case 2: //Julia for z^2 + c
-			//Arg represents the chosen 'c' now, and c is the location
-			c = c * c + arg;
-			break;
-		case 3:
-			c = c * c * c + arg;
+	//Bailout compares squared magnitudes, saving a square root every step
+	long double limit = threshold * threshold;
+	//For the Julia types arg is the constant and c the orbit
+	bool julia = type % 4 >= 2;
+	clong_double& z = julia ? c : arg;
+	const clong_double& k = julia ? arg : c;
+	//Brent's cycle finding: the orbit is compared with where it was at the last power of two steps
+	clong_double saved = z;
+	std::size_t saved_at = 0, next_save = 8;
+	bool detect = period != NULL && tolerance > 0 && type % 4 != 1;
+	if (period)
+		*period = 0;
+	//Past an escape radius of at least 2 an orbit whose constant is no further out only grows, as |z|^2 - |k| is
+	//at least |z| there. So a chunk of escape_chunk steps that ends inside the escape radius never left it on the way, and chunks can run
+	//without a test per step. A chunk that ends outside, or comes near the saved point, is rolled back to where
+	//it began and stepped one at a time to find exactly where that happened. Powers of two from 8 up all fall
+	//between chunks, so the saved points are the same either way.
+	bool chunked = threshold >= 2 && k.norm() <= limit;
+	for (;;) {
+		while (chunked && i + escape_chunk <= static_cast<std::size_t>(depth) && z.norm() < limit) {
+			clong_double snapshot = z;
+			bool near = false;
+			for (int s = 0; s < escape_chunk; ++s) {
+				escape_step(type % 4, z, k);
+				long double dr = z.real - saved.real, di = z.imaginary - saved.imaginary;
+				near |= detect && dr * dr + di * di < tolerance;
+			}
+			if (near || !(z.norm() < limit)) {
+				z = snapshot;
+				break;
+			}
+			i += escape_chunk;
+			if (detect && i == next_save) {
+				saved = z;
+				saved_at = i;
+				next_save *= 2;
+			}
+		}
+		std::size_t stop = chunked ? std::min(i + escape_chunk, static_cast<std::size_t>(depth)) : static_cast<std::size_t>(depth);
+		while (z.norm() < limit && i < stop) {
+			escape_step(type % 4, z, k);
+			++i;
+			if (detect) {
+				long double dr = z.real - saved.real, di = z.imaginary - saved.imaginary;
+				if (dr * dr + di * di < tolerance) {
+					int steps = shortest_period(type % 4, z, k, static_cast<int>(i - saved_at), tolerance);
+					long double distance;
+					if (attracting_cycle(type % 4, z, k, steps, distance)) {
+						*period = steps;
+						if (inside)
+							*inside = distance;
+						if (last)
+							*last = z;
+						return std::make_pair(false, 0);
+					}
+				}
+				if (i == next_save) {
+					saved = z;
+					saved_at = i;
+					next_save *= 2;
+				}
+			}
 		}
-		++i;
+		if (!chunked || i == static_cast<std::size_t>(depth) || !(z.norm() < limit))
+			break;
 	}
-	if (fractal_type % 4 >= 2) {
+	if (type % 4 >= 2)
 		std::swap(arg, c);
-		if (arg.magnitude() > threshold) {
+	if (last)
+		*last = arg;
+	if (type % 4 >= 2) {
+		if (arg.norm() > limit) {
 			return std::make_pair(true, depth - i);
 		}
 		return std::make_pair(false, 0);
 	}
 	//Test for convergence approximately (not airtight by any means)
-	if (arg.magnitude() >= threshold)
+	if (arg.norm() >= limit)
 		return std::make_pair(true, depth - i);
 	assert(depth == i);
 	return std::make_pair(false, 0);
 	//return mandelbrot(z, c, threshold, depth - 1);
 }
 
+//Evaluate a complex fractal plot value for a given complex number
+std::pair<bool, int> mandelbrot(clong_double arg, clong_double c, long double threshold, int depth) {
+	return escape(fractal_type, arg, c, threshold, depth);
+}
+
 
 
 #endif
@@ -0,0 +1,139 @@
+#pragma once
+//Distance estimation: the orbit's derivative says how far a point is from the set, so whole discs of the
+//exterior can be filled from one evaluation and only pixels near the boundary are computed
+#ifndef __DISTANCE_H__
+#define __DISTANCE_H__
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "render.h"
+
+//Distance frames hold shades 0..distance_shades - 1 instead of iteration values: 0 on the boundary, rising
+//evenly to the top shade distance_reach pixels away and staying there
+const int distance_shades = 256;
+const long double distance_reach = 4.0;
+
+//Orbits are followed this far past the escape radius, where the estimate is good, unless that takes more steps
+const long double distance_radius = 1e10;
+const int distance_extra_steps = 16;
+
+//Like escape(), but also following the derivative of the orbit with respect to the pixel's point, which gives
+//a lower bound on the distance to the set by Koebe's quarter theorem: |z| log|z| / (2 |dz|). Only the
+//Mandelbrot and Julia maps are conformal; for the burning ship false is returned and nothing else is touched.
+bool escape_distance(int type, clong_double arg, clong_double c, long double threshold, int depth, bool& escaped, long double& distance) {
+	type %= 4;
+	if (type == 1)
+		return false;
+	//The orbit and its derivative: with respect to c for the Mandelbrot set, to the starting point for Julia sets
+	clong_double z = (type == 0) ? arg : c;
+	clong_double dz = (type == 0) ? clong_double(0.0, 0.0) : clong_double(1.0, 0.0);
+	clong_double k = (type == 0) ? c : arg;
+	int i = 0;
+	long double limit = threshold * threshold;
+	while (z.norm() < limit && i < depth) {
+		if (type == 3) {
+			dz = 3.0 * (z * z) * dz;
+			z = z * z * z + k;
+		}
+		else {
+			dz = (type == 0) ? 2.0 * z * dz + 1.0 : 2.0 * z * dz;
+			z = z * z + k;
+		}
+		++i;
+	}
+	escaped = z.norm() >= limit;
+	if (!escaped)
+		return true;
+	for (int extra = 0; extra < distance_extra_steps && z.norm() < distance_radius * distance_radius; ++extra) {
+		clong_double next_dz = (type == 3) ? 3.0 * (z * z) * dz : ((type == 0) ? 2.0 * z * dz + 1.0 : 2.0 * z * dz);
+		clong_double next_z = (type == 3) ? z * z * z + k : z * z + k;
+		if (!std::isfinite(static_cast<double>(next_z.norm())) || !std::isfinite(static_cast<double>(next_dz.norm())))
+			break;
+		z = next_z;
+		dz = next_dz;
+	}
+	long double radius = z.magnitude(), slope = dz.magnitude();
+	distance = (slope > 0) ? radius * logl(radius) / (2 * slope) : HUGE_VALL;
+	return true;
+}
+
+//Whether the estimate is a true lower bound for this fractal: the quarter theorem needs the set connected,
+//which the Mandelbrot set (from 0) is, and a Julia set is when its critical point 0 does not escape
+bool distance_bounded(const fractal_view& view) {
+	switch (view.fractal_type % 4) {
+	case 0:
+		return view.starting_point.real == 0 && view.starting_point.imaginary == 0;
+	case 2:
+	case 3:
+		return !escape(view.fractal_type, view.starting_point, clong_double(0.0, 0.0), escape_threshold, view.maxiterations).first;
+	}
+	return false;
+}
+
+//Shade for a distance of so many pixels
+int distance_shade(long double pixels) {
+	if (!(pixels < distance_reach))
+		return distance_shades - 1;
+	return std::max(0, static_cast<int>(pixels / distance_reach * (distance_shades - 1)));
+}
+
+//Fill a width x height frame of view with distance shades (interior for points that never escape). Pixels are
+//taken coarse to fine, every 16th first; each escaping one whose disc of known exterior reaches far enough
+//that everything in it is at the top shade paints that disc, so later passes only refine near the boundary.
+//Returns how many pixels were evaluated, or -1 if the fractal has no distance estimate to trust.
+long long render_distance(const fractal_view& view, int width, int height, int* out, thread_pool& pool) {
+	if (!distance_bounded(view))
+		return -1;
+	long double pixel_x = view_width(view) / width, pixel_y = view_height(view) / height;
+	long double pixel = std::max(pixel_x, pixel_y);
+	std::vector<unsigned char> known(static_cast<std::size_t>(width) * height, 0);
+	long long evaluated = 0;
+	for (int stride = 16; stride >= 1; stride /= 2) {
+		//This pass's pixels: those on its grid that no coarser grid or disc has covered
+		std::vector<std::pair<int, int> > todo;
+		for (int i = 0; i < height; i += stride)
+			for (int j = 0; j < width; j += stride)
+				if (!known[static_cast<std::size_t>(i) * width + j] && (stride == 16 || i % (2 * stride) || j % (2 * stride)))
+					todo.push_back(std::make_pair(j, i));
+		std::vector<int> shades(todo.size());
+		std::vector<long double> reach(todo.size(), 0);
+		pool.parallel_for(0, static_cast<int>(todo.size()), [&](int t) {
+			bool escaped = false;
+			long double distance = 0;
+			escape_distance(view.fractal_type, view.starting_point, pixel_point(view, todo[t].first, todo[t].second, width, height),
+				escape_threshold, view.maxiterations, escaped, distance);
+			shades[t] = escaped ? distance_shade(distance / pixel) : interior;
+			//Any estimate taken inside the disc is at least a quarter of what is left of the distance there
+			if (escaped)
+				reach[t] = distance - 4 * distance_reach * pixel;
+		});
+		evaluated += static_cast<long long>(todo.size());
+		for (std::size_t t = 0; t < todo.size(); ++t) {
+			int j = todo[t].first, i = todo[t].second;
+			std::size_t p = static_cast<std::size_t>(i) * width + j;
+			if (known[p])
+				continue;
+			known[p] = 1;
+			out[p] = shades[t];
+			if (reach[t] <= 0)
+				continue;
+			long double across = reach[t] / pixel_x, down = reach[t] / pixel_y;
+			int i0 = std::max(0, static_cast<int>(ceill(i - down))), i1 = std::min(height - 1, static_cast<int>(floorl(i + down)));
+			for (int b = i0; b <= i1; ++b) {
+				long double dy = (b - i) / down;
+				long double half = across * sqrtl(std::max(0.0L, 1 - dy * dy));
+				int j0 = std::max(0, static_cast<int>(ceill(j - half))), j1 = std::min(width - 1, static_cast<int>(floorl(j + half)));
+				for (int a = j0; a <= j1; ++a) {
+					std::size_t q = static_cast<std::size_t>(b) * width + a;
+					if (!known[q]) {
+						known[q] = 1;
+						out[q] = distance_shades - 1;
+					}
+				}
+			}
+		}
+	}
+	return evaluated;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+//Double-double numbers: a double plus the rounding error it leaves, about 106 bits of significand in all, for
+//zooms past what long double resolves but not so deep as to need arbitrary precision
+#ifndef __DOUBLEDOUBLE_H__
+#define __DOUBLEDOUBLE_H__
+#include <cmath>
+#include "complex.h"
+
+//The unevaluated sum hi + lo, with lo no more than half a unit in the last place of hi. Every operation is built
+//from error-free transforms: a + b and a * b are each split exactly into a rounded result and its error.
+struct double_double {
+	// REPRESENTATION
+	double hi;
+	double lo;
+	constexpr double_double() noexcept : hi(0), lo(0) {}
+	constexpr double_double(int value) noexcept : hi(value), lo(0) {}
+	constexpr double_double(double value) noexcept : hi(value), lo(0) {}
+	constexpr double_double(double hi_, double lo_) noexcept : hi(hi_), lo(lo_) {}
+	//Exact unless long double has more than 106 bits
+	double_double(long double value) noexcept : hi(static_cast<double>(value)), lo(static_cast<double>(value - static_cast<long double>(static_cast<double>(value)))) {}
+	explicit operator long double() const noexcept {
+		return static_cast<long double>(hi) + static_cast<long double>(lo);
+	}
+	explicit operator double() const noexcept {
+		return hi;
+	}
+};
+
+//a + b as s + error exactly, whatever the sizes of a and b
+double two_sum(double a, double b, double& error) noexcept {
+	double s = a + b;
+	double v = s - a;
+	error = (a - (s - v)) + (b - v);
+	return s;
+}
+
+//a + b as s + error exactly, given |a| >= |b|
+double quick_two_sum(double a, double b, double& error) noexcept {
+	double s = a + b;
+	error = b - (s - a);
+	return s;
+}
+
+//Whether std::fma is one instruction here rather than a call into the library
+#if defined(FP_FAST_FMA) || defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define DOUBLEDOUBLE_FAST_FMA 1
+#endif
+
+//a as hi + lo, each with at most 26 significant bits, so their products with each other are exact (Dekker); a
+//must be well inside the range of double, as orbits inside the escape radius are
+double dekker_split(double a, double& lo) noexcept {
+	double t = 134217729.0 * a;
+	double hi = t - (t - a);
+	lo = a - hi;
+	return hi;
+}
+
+//a * b as p + error exactly: the error from one fused multiply-add where the target has them, and otherwise from
+//Dekker's split, which gives the same error in plain multiplies and adds the compiler can vectorize
+double two_product(double a, double b, double& error) noexcept {
+	double p = a * b;
+#ifdef DOUBLEDOUBLE_FAST_FMA
+	error = std::fma(a, b, -p);
+#else
+	double a_lo, b_lo;
+	double a_hi = dekker_split(a, a_lo), b_hi = dekker_split(b, b_lo);
+	error = ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+#endif
+	return p;
+}
+
+double_double operator+ (const double_double& a, const double_double& b) noexcept {
+	double e, f;
+	double s = two_sum(a.hi, b.hi, e);
+	double t = two_sum(a.lo, b.lo, f);
+	e += t;
+	s = quick_two_sum(s, e, e);
+	e += f;
+	s = quick_two_sum(s, e, e);
+	return double_double(s, e);
+}
+
+double_double operator- (const double_double& a) noexcept {
+	return double_double(-a.hi, -a.lo);
+}
+
+double_double operator- (const double_double& a, const double_double& b) noexcept {
+	return a + -b;
+}
+
+double_double operator* (const double_double& a, const double_double& b) noexcept {
+	double e;
+	double p = two_product(a.hi, b.hi, e);
+	e += a.hi * b.lo + a.lo * b.hi;
+	p = quick_two_sum(p, e, e);
+	return double_double(p, e);
+}
+
+double_double operator/ (const double_double& a, double b) noexcept {
+	double e, f;
+	double q = a.hi / b;
+	double p = two_product(q, b, f);
+	double s = two_sum(a.hi, -p, e);
+	e -= f;
+	e += a.lo;
+	double r = (s + e) / b;
+	q = quick_two_sum(q, r, r);
+	return double_double(q, r);
+}
+
+double_double& operator+= (double_double& a, const double_double& b) noexcept {
+	return a = a + b;
+}
+
+double_double& operator-= (double_double& a, const double_double& b) noexcept {
+	return a = a - b;
+}
+
+double_double& operator*= (double_double& a, const double_double& b) noexcept {
+	return a = a * b;
+}
+
+bool operator< (const double_double& a, const double_double& b) noexcept {
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+bool operator> (const double_double& a, const double_double& b) noexcept {
+	return b < a;
+}
+
+bool operator<= (const double_double& a, const double_double& b) noexcept {
+	return !(b < a);
+}
+
+bool operator>= (const double_double& a, const double_double& b) noexcept {
+	return !(a < b);
+}
+
+bool operator== (const double_double& a, const double_double& b) noexcept {
+	return a.hi == b.hi && a.lo == b.lo;
+}
+
+bool operator!= (const double_double& a, const double_double& b) noexcept {
+	return !(a == b);
+}
+
+double_double abs(const double_double& a) noexcept {
+	return (a.hi < 0) ? -a : a;
+}
+
+typedef basic_complex<double_double> cdouble_double;
+
+#endif
@@ -0,0 +1,202 @@
+#pragma once
+//Exponential-map zooms: render one log-polar strip around the zoom target, then resample every frame from it
+#ifndef __EXPMAP_H__
+#define __EXPMAP_H__
+#include <cmath>
+#include <string>
+#include <vector>
+#include "animation.h"
+
+const long double expmap_pi = 3.14159265358979323846264338327950288L;
+
+//A log-polar strip around center. Row u is the ring of radius outer * exp(-u * step) and column v is
+//the angle v * step - pi, so every sample is square and each ring of the zoom is computed exactly once.
+//Only a window of rows is kept in memory; it slides inward (or outward) as frames ask for other radii.
+class expmap_strip {
+public:
+	expmap_strip(const fractal_view& view_, clong_double center_, long double outer_, int columns_, const std::vector<unsigned char>& palette_)
+		: view(view_), center(center_), outer(outer_), columns(columns_), palette(palette_) {
+		step = 2.0 * expmap_pi / columns;
+		first = 0;
+		computed = 0;
+	}
+	//Make rows [lo, hi) available, computing only rows never seen before and dropping rows outside the range
+	void require(long long lo, long long hi) {
+		lo = std::max(0LL, lo);
+		hi = std::max(lo, hi);
+		long long have_lo = first, have_hi = first + static_cast<long long>(rows.size()) / row_bytes();
+		if (hi <= have_lo || lo >= have_hi || rows.empty()) {
+			rows.clear();
+			first = lo;
+			have_lo = have_hi = lo;
+		}
+		else {
+			//Drop what is no longer needed off either end
+			if (have_hi > hi)
+				rows.resize((hi - first) * row_bytes());
+			if (have_lo < lo) {
+				rows.erase(rows.begin(), rows.begin() + (lo - first) * row_bytes());
+				first = lo;
+			}
+			have_lo = first;
+			have_hi = first + static_cast<long long>(rows.size()) / row_bytes();
+		}
+		if (lo < have_lo) {
+			std::vector<unsigned char> front((have_lo - lo) * row_bytes());
+			compute(lo, have_lo, &front[0]);
+			rows.insert(rows.begin(), front.begin(), front.end());
+			first = lo;
+		}
+		if (hi > have_hi) {
+			std::size_t old = rows.size();
+			rows.resize(old + (hi - have_hi) * row_bytes());
+			compute(have_hi, hi, &rows[old]);
+		}
+	}
+	//Fractional strip coordinates of a point at offset (x, y) from the center
+	void locate(long double x, long double y, long double& u, long double& v) const {
+		u = (logl(outer) - 0.5 * logl(x * x + y * y)) / step;
+		v = (atan2l(y, x) + expmap_pi) / step;
+	}
+	//Bilinear sample of the colored strip at (u, v); the angle wraps around
+	void sample(long double u, long double v, unsigned char* rgb) const {
+		long long r = static_cast<long long>(floorl(u));
+		long long c = static_cast<long long>(floorl(v));
+		float fu = static_cast<float>(u - r), fv = static_cast<float>(v - c);
+		const unsigned char* p[4] = { at(r, c), at(r, c + 1), at(r + 1, c), at(r + 1, c + 1) };
+		for (int k = 0; k < 3; ++k) {
+			float top = p[0][k] + (p[1][k] - p[0][k]) * fv;
+			float bottom = p[2][k] + (p[3][k] - p[2][k]) * fv;
+			rgb[k] = static_cast<unsigned char>(top + (bottom - top) * fu + 0.5f);
+		}
+	}
+	long double ring_step() const { return step; }
+	long long rows_computed() const { return computed; }
+	int width() const { return columns; }
+private:
+	// REPRESENTATION
+	fractal_view view;
+	clong_double center;
+	long double outer;
+	int columns;
+	long double step;
+	const std::vector<unsigned char>& palette;
+	//Colored rows [first, first + rows.size() / row_bytes())
+	std::vector<unsigned char> rows;
+	long long first;
+	long long computed;
+	std::size_t row_bytes() const { return static_cast<std::size_t>(columns) * 3; }
+	const unsigned char* at(long long r, long long c) const {
+		long long last = first + static_cast<long long>(rows.size()) / row_bytes() - 1;
+		r = std::max(first, std::min(last, r));
+		c = ((c % columns) + columns) % columns;
+		return &rows[(r - first) * row_bytes() + c * 3];
+	}
+	void compute(long long lo, long long hi, unsigned char* out) {
+		render_pool().parallel_for(0, static_cast<int>(hi - lo), [&](int k) {
+			long double radius = outer * expl(-(lo + k) * step);
+			std::vector<int> ring(columns);
+			for (int c = 0; c < columns; ++c) {
+				long double angle = c * step - expmap_pi;
+				ring[c] = evaluate(view, clong_double(center.real + radius * cosl(angle), center.imaginary + radius * sinl(angle)), radius * step);
+			}
+			colorize(&ring[0], columns, palette, out + k * row_bytes());
+		});
+		computed += hi - lo;
+	}
+};
+
+//Render a zoom from start_width to end_width toward center. Each frame takes its rings from the strip;
+//only the sub-pixel disc right at the center of the deepest frames is evaluated directly.
+int render_expmap(const fractal_view& base, clong_double center, long double start_width, long double end_width, long long frames,
+	int width, int height, const gradient& scheme, long double moddenom, frame_writer& out) {
+	std::vector<unsigned char> palette = build_palette(scheme, base.maxiterations, moddenom);
+	long double aspect = static_cast<long double>(height) / static_cast<long double>(width);
+	//Enough angular samples that the outermost ring is no coarser than the frame's own pixels
+	long double corner = 0.5 * sqrtl(static_cast<long double>(width) * width + static_cast<long double>(height) * height);
+	int columns = static_cast<int>(ceill(2.0 * expmap_pi * corner));
+	expmap_strip strip(base, center, std::max(start_width, end_width) / width * corner * 1.01, columns, palette);
+	std::vector<unsigned char> rgb(static_cast<std::size_t>(width) * height * 3);
+	for (long long f = 0; f < frames; ++f) {
+		long double t = (frames > 1) ? static_cast<long double>(f) / (frames - 1) : 0.0;
+		long double frame_width = start_width * powl(end_width / start_width, t);
+		long double pixel = frame_width / width;
+		fractal_view view = base;
+		view.xmin = center.real - frame_width / 2.0;
+		view.xmax = center.real + frame_width / 2.0;
+		view.ymin = center.imaginary - frame_width * aspect / 2.0;
+		view.ymax = center.imaginary + frame_width * aspect / 2.0;
+		//Rings from the frame's corners down to half a pixel from the center
+		long double u_outer, u_inner, v;
+		strip.locate(pixel * corner, 0.0, u_outer, v);
+		strip.locate(pixel * 0.5, 0.0, u_inner, v);
+		strip.require(static_cast<long long>(floorl(u_outer)) - 1, static_cast<long long>(ceill(u_inner)) + 2);
+		render_pool().parallel_for(0, height, [&](int i) {
+			for (int j = 0; j < width; ++j) {
+				clong_double dot = pixel_point(view, j, i, width, height);
+				long double x = dot.real - center.real, y = dot.imaginary - center.imaginary;
+				unsigned char* px = &rgb[(static_cast<std::size_t>(i) * width + j) * 3];
+				if (x * x + y * y < 0.25 * pixel * pixel) {
+					int it = evaluate(view, dot, pixel);
+					colorize(&it, 1, palette, px);
+					continue;
+				}
+				long double u, v;
+				strip.locate(x, y, u, v);
+				strip.sample(u, v, px);
+			}
+		});
+		if (!out.write(&rgb[0])) {
+			fprintf(stderr, "expmap: write failed at frame %lld\n", f);
+			return 1;
+		}
+		fprintf(stderr, "expmap: frame %lld of %lld, %lld rings so far\n", f + 1, frames, strip.rows_computed());
+	}
+	fprintf(stderr, "expmap: %lld x %d strip samples for %lld frames of %d x %d\n", strip.rows_computed(), columns, frames, width, height);
+	return 0;
+}
+
+//Entry point for "--expmap <center_re> <center_im> <start_width> <end_width> <frames> <width> <height> <output|->
+//[--format=y4m|ppm] [--fps=n] [--scheme=n] [--type=n] [--iter=n] [--start=re,im]"
+int expmap_main(int argc, char** argv, const fractal_view& defaults, const std::vector<gradient>& gradients, long double moddenom) {
+	if (argc < 8) {
+		fprintf(stderr, "usage: --expmap <center_re> <center_im> <start_width> <end_width> <frames> <width> <height> <output|-> [--format=y4m|ppm] [--fps=n] [--scheme=n] [--type=n] [--iter=n] [--start=re,im]\n");
+		return 1;
+	}
+	fractal_view base = defaults;
+	clong_double center(strtold(argv[0], NULL), strtold(argv[1], NULL));
+	long double start_width = strtold(argv[2], NULL);
+	long double end_width = strtold(argv[3], NULL);
+	long long frames = atoll(argv[4]);
+	int width = atoi(argv[5]);
+	int height = atoi(argv[6]);
+	std::string path = argv[7];
+	std::string format = (path.size() > 4 && path.compare(path.size() - 4, 4, ".ppm") == 0) ? "ppm" : "y4m";
+	int fps = 30;
+	int scheme = 0;
+	for (int a = 8; a < argc; ++a) {
+		std::string arg = argv[a];
+		if (arg.compare(0, 9, "--format=") == 0)
+			format = arg.substr(9);
+		else if (arg.compare(0, 6, "--fps=") == 0)
+			fps = atoi(arg.c_str() + 6);
+		else if (arg.compare(0, 9, "--scheme=") == 0)
+			scheme = atoi(arg.c_str() + 9);
+		else if (!parse_view_option(arg, base)) {
+			fprintf(stderr, "expmap: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (start_width <= 0.0 || end_width <= 0.0 || frames <= 0 || width <= 0 || height <= 0 || fps <= 0 || (format != "y4m" && format != "ppm")) {
+		fprintf(stderr, "expmap: bad widths, frame count, size, frame rate or format\n");
+		return 1;
+	}
+	frame_writer out;
+	if (!out.open(path, format, width, height, fps)) {
+		fprintf(stderr, "expmap: cannot open %s\n", path.c_str());
+		return 1;
+	}
+	return render_expmap(base, center, start_width, end_width, frames, width, height, gradients[scheme % gradients.size()], moddenom, out);
+}
+
+#endif
@@ -0,0 +1,357 @@
+#pragma once
+//Tile farm: a coordinator splits one big render into tiles and hands them to worker processes over TCP
+#ifndef __FARM_H__
+#define __FARM_H__
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "net.h"
+#include "poster.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//		FARM PROTOCOL (one text line per message, tile results followed by raw bytes)
+//
+//	worker -> coordinator:	HELLO
+//	coordinator -> worker:	TILE <id> <column0> <row0> <columns> <rows> <image width> <image height> <view_to_string>
+//	worker -> coordinator:	WORKING <id>, every farm_keepalive_seconds while the tile renders
+//	worker -> coordinator:	DONE <id> <byte count>, then columns * rows little-endian int32 iteration values
+//	coordinator -> worker:	BYE
+//
+
+//How often a worker says it is still rendering. The coordinator's timeout only counts silence, so a tile may take
+//as long as it needs; slow workers are overtaken by duplicating their tiles instead.
+const int farm_keepalive_seconds = 10;
+
+//One rectangle of the output image and the bookkeeping needed to farm it out
+struct farm_tile {
+	long long column0;
+	long long row0;
+	int columns;
+	int rows;
+	int retries;
+	bool done;
+	//Workers currently rendering this tile; more than one when a slow worker's tile is duplicated
+	std::set<int> assigned;
+	std::chrono::steady_clock::time_point started;
+};
+
+//The coordinator's shared state; every connection thread goes through it
+class farm_job {
+public:
+	farm_job(const poster_job& job_, const gradient& scheme, long double moddenom, int tile_size, int max_retries_)
+		: job(job_), header(poster_header(job_)), max_retries(max_retries_) {
+		palette = build_palette(scheme, job.view.maxiterations, moddenom);
+		for (long long r = 0; r < job.height; r += tile_size)
+			for (long long c = 0; c < job.width; c += tile_size) {
+				farm_tile tile;
+				tile.column0 = c;
+				tile.row0 = r;
+				tile.columns = static_cast<int>(std::min<long long>(tile_size, job.width - c));
+				tile.rows = static_cast<int>(std::min<long long>(tile_size, job.height - r));
+				tile.retries = 0;
+				tile.done = false;
+				pending.push_back(tiles.size());
+				tiles.push_back(tile);
+			}
+		finished = 0;
+		failed = false;
+		average_seconds = 0.0;
+		out = NULL;
+	}
+	~farm_job() {
+		if (out)
+			fclose(out);
+	}
+	//Create the pre-sized output file, exactly like a poster
+	bool open_output() {
+		out = open_file(job.path, "w+b");
+		if (!out)
+			return false;
+		fwrite(header.data(), 1, header.size(), out);
+		seek_file(out, header.size() + job.width * job.height * 3 - 1);
+		fputc(0, out);
+		return true;
+	}
+	//Pick the next tile for a worker: a pending one if any, otherwise a copy of a tile that has been out far
+	//longer than tiles usually take, so a fast worker can overtake a slow one. Returns -1 once the job is over.
+	int next_tile(int worker) {
+		std::unique_lock<std::mutex> lock(guard);
+		while (!failed && finished < tiles.size()) {
+			if (!pending.empty()) {
+				int t = pending.front();
+				pending.pop_front();
+				assign(t, worker);
+				return t;
+			}
+			int slowest = -1;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			for (std::size_t t = 0; t < tiles.size(); ++t) {
+				const farm_tile& tile = tiles[t];
+				if (tile.done || tile.assigned.count(worker) || tile.assigned.size() > 1)
+					continue;
+				double seconds = std::chrono::duration<double>(now - tile.started).count();
+				if (finished > 0 && seconds > 1.0 && seconds > 3.0 * average_seconds && (slowest < 0 || tile.started < tiles[slowest].started))
+					slowest = static_cast<int>(t);
+			}
+			if (slowest >= 0) {
+				tiles[slowest].assigned.insert(worker);
+				return slowest;
+			}
+			changed.wait_for(lock, std::chrono::milliseconds(200));
+		}
+		return -1;
+	}
+	//A worker died or timed out on a tile; requeue it unless someone else is still on it
+	void tile_failed(int t, int worker) {
+		std::lock_guard<std::mutex> lock(guard);
+		farm_tile& tile = tiles[t];
+		tile.assigned.erase(worker);
+		if (tile.done || !tile.assigned.empty())
+			return;
+		if (++tile.retries > max_retries) {
+			fprintf(stderr, "farm: tile %d failed %d times, giving up\n", t, tile.retries);
+			failed = true;
+		}
+		else
+			pending.push_front(t);
+		changed.notify_all();
+	}
+	//Store a finished tile; only the first copy of a duplicated tile is written
+	bool tile_done(int t, int worker, const std::vector<int>& iterations) {
+		std::lock_guard<std::mutex> lock(guard);
+		farm_tile& tile = tiles[t];
+		tile.assigned.erase(worker);
+		if (tile.done)
+			return true;
+		std::vector<unsigned char> rgb(iterations.size() * 3);
+		colorize(&iterations[0], iterations.size(), palette, &rgb[0]);
+		for (int r = 0; r < tile.rows; ++r) {
+			long long offset = header.size() + ((tile.row0 + r) * job.width + tile.column0) * 3;
+			if (!seek_file(out, offset) || fwrite(&rgb[r * tile.columns * 3], 3, tile.columns, out) != static_cast<std::size_t>(tile.columns)) {
+				failed = true;
+				changed.notify_all();
+				return false;
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tile.started).count();
+		tile.done = true;
+		++finished;
+		average_seconds += (seconds - average_seconds) / finished;
+		if (finished % 64 == 0 || finished == tiles.size())
+			fprintf(stderr, "farm: %d of %d tiles\n", static_cast<int>(finished), static_cast<int>(tiles.size()));
+		changed.notify_all();
+		return true;
+	}
+	std::string tile_message(int t) {
+		std::lock_guard<std::mutex> lock(guard);
+		const farm_tile& tile = tiles[t];
+		char buffer[256];
+		snprintf(buffer, sizeof(buffer), "TILE %d %lld %lld %d %d %lld %lld ", t, tile.column0, tile.row0, tile.columns, tile.rows, job.width, job.height);
+		return buffer + view_to_string(job.view);
+	}
+	std::size_t tile_pixels(int t) {
+		std::lock_guard<std::mutex> lock(guard);
+		return static_cast<std::size_t>(tiles[t].columns) * tiles[t].rows;
+	}
+	bool over() {
+		std::lock_guard<std::mutex> lock(guard);
+		return failed || finished == tiles.size();
+	}
+	bool succeeded() {
+		std::lock_guard<std::mutex> lock(guard);
+		return !failed && finished == tiles.size();
+	}
+private:
+	// REPRESENTATION
+	poster_job job;
+	std::string header;
+	std::vector<unsigned char> palette;
+	std::vector<farm_tile> tiles;
+	std::deque<int> pending;
+	std::size_t finished;
+	bool failed;
+	int max_retries;
+	double average_seconds;
+	FILE* out;
+	std::mutex guard;
+	std::condition_variable changed;
+	void assign(int t, int worker) {
+		tiles[t].assigned.insert(worker);
+		tiles[t].started = std::chrono::steady_clock::now();
+	}
+};
+
+//Pack iteration values little-endian so workers on other machines agree with the coordinator
+void pack_iterations(const std::vector<int>& iterations, std::vector<unsigned char>& bytes) {
+	bytes.resize(iterations.size() * 4);
+	for (std::size_t p = 0; p < iterations.size(); ++p) {
+		unsigned int v = static_cast<unsigned int>(iterations[p]);
+		for (int k = 0; k < 4; ++k)
+			bytes[4 * p + k] = static_cast<unsigned char>(v >> (8 * k));
+	}
+}
+
+void unpack_iterations(const std::vector<unsigned char>& bytes, std::vector<int>& iterations) {
+	iterations.resize(bytes.size() / 4);
+	for (std::size_t p = 0; p < iterations.size(); ++p) {
+		unsigned int v = 0;
+		for (int k = 0; k < 4; ++k)
+			v |= static_cast<unsigned int>(bytes[4 * p + k]) << (8 * k);
+		iterations[p] = static_cast<int>(v);
+	}
+}
+
+//Serve tiles to one connected worker until the job is over or the worker fails; the caller owns the socket
+void serve_worker(farm_job& farm, socket_handle s, int worker) {
+	std::string line;
+	if (!recv_line(s, line) || line != "HELLO")
+		return;
+	fprintf(stderr, "farm: worker %d connected\n", worker);
+	std::vector<unsigned char> bytes;
+	std::vector<int> iterations;
+	int t;
+	while ((t = farm.next_tile(worker)) >= 0) {
+		long long reply[2];
+		bool ok = send_line(s, farm.tile_message(t)) && recv_line(s, line);
+		while (ok && line.compare(0, 8, "WORKING ") == 0)
+			ok = recv_line(s, line);
+		ok = ok && line.compare(0, 5, "DONE ") == 0
+			&& parse_integers(line.c_str() + 5, reply, 2) && reply[0] == t
+			&& reply[1] == static_cast<long long>(farm.tile_pixels(t) * 4);
+		if (ok) {
+			bytes.resize(static_cast<std::size_t>(reply[1]));
+			ok = recv_all(s, &bytes[0], bytes.size());
+		}
+		if (!ok) {
+			fprintf(stderr, "farm: worker %d lost on tile %d\n", worker, t);
+			farm.tile_failed(t, worker);
+			return;
+		}
+		unpack_iterations(bytes, iterations);
+		farm.tile_done(t, worker, iterations);
+	}
+	send_line(s, "BYE");
+}
+
+//Entry point for "--farm <port> <width> <height> <output.ppm> [--tile=n] [--timeout=seconds] [--retries=n] [--scheme=n] [view options]"
+int farm_main(int argc, char** argv, const fractal_view& defaults, const std::vector<gradient>& gradients, long double moddenom) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: --farm <port> <width> <height> <output.ppm> [--tile=n] [--timeout=seconds] [--retries=n] [--scheme=n] [--view=xmin,xmax,ymin,ymax] [--type=n] [--iter=n] [--start=re,im]\n");
+		return 1;
+	}
+	poster_job job;
+	job.view = defaults;
+	int port = atoi(argv[0]);
+	job.width = atoll(argv[1]);
+	job.height = atoll(argv[2]);
+	job.path = argv[3];
+	job.band_rows = 0;
+	job.scheme = 0;
+	int tile_size = 256;
+	int timeout = 300;
+	int retries = 3;
+	for (int a = 4; a < argc; ++a) {
+		std::string arg = argv[a];
+		if (arg.compare(0, 7, "--tile=") == 0)
+			tile_size = atoi(arg.c_str() + 7);
+		else if (arg.compare(0, 10, "--timeout=") == 0)
+			timeout = atoi(arg.c_str() + 10);
+		else if (arg.compare(0, 10, "--retries=") == 0)
+			retries = atoi(arg.c_str() + 10);
+		else if (arg.compare(0, 9, "--scheme=") == 0)
+			job.scheme = atoi(arg.c_str() + 9);
+		else if (!parse_view_option(arg, job.view)) {
+			fprintf(stderr, "farm: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (job.width <= 0 || job.height <= 0 || tile_size <= 0 || job.view.maxiterations <= 0) {
+		fprintf(stderr, "farm: width, height, tile size and iterations must be positive\n");
+		return 1;
+	}
+	job.scheme %= gradients.size();
+	farm_job farm(job, gradients[job.scheme], moddenom, tile_size, retries);
+	if (!farm.open_output()) {
+		fprintf(stderr, "farm: cannot open %s\n", job.path.c_str());
+		return 1;
+	}
+	socket_handle listener = listen_on(port);
+	if (listener == no_socket) {
+		fprintf(stderr, "farm: cannot listen on port %d\n", port);
+		return 1;
+	}
+	fprintf(stderr, "farm: listening on port %d\n", local_port(listener));
+	std::vector<std::thread> connections;
+	std::vector<socket_handle> sockets;
+	while (!farm.over()) {
+		socket_handle s = accept_within(listener, 200);
+		if (s == no_socket)
+			continue;
+		set_receive_timeout(s, timeout);
+		sockets.push_back(s);
+		connections.push_back(std::thread(serve_worker, std::ref(farm), s, static_cast<int>(connections.size())));
+	}
+	close_socket(listener);
+	//Workers still chewing on duplicated tiles are no longer needed
+	for (std::size_t k = 0; k < sockets.size(); ++k)
+		shutdown_socket(sockets[k]);
+	for (std::size_t k = 0; k < connections.size(); ++k) {
+		connections[k].join();
+		close_socket(sockets[k]);
+	}
+	return farm.succeeded() ? 0 : 1;
+}
+
+//Entry point for "--farm-worker <host> <port>": render tiles for a coordinator until it says BYE
+int farm_worker_main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: --farm-worker <host> <port>\n");
+		return 1;
+	}
+	socket_handle s = connect_to(argv[0], atoi(argv[1]));
+	if (s == no_socket || !send_line(s, "HELLO")) {
+		fprintf(stderr, "farm-worker: cannot reach %s:%s\n", argv[0], argv[1]);
+		return 1;
+	}
+	std::string line;
+	std::vector<int> iterations;
+	std::vector<unsigned char> bytes;
+	while (recv_line(s, line) && line.compare(0, 5, "TILE ") == 0) {
+		//id, column0, row0, columns, rows, image width, image height
+		long long fields[7];
+		const char* rest = parse_integers(line.c_str() + 5, fields, 7);
+		fractal_view view;
+		if (!rest || !view_from_string(rest, view) || fields[3] <= 0 || fields[4] <= 0) {
+			fprintf(stderr, "farm-worker: bad request %s\n", line.c_str());
+			break;
+		}
+		int columns = static_cast<int>(fields[3]), rows = static_cast<int>(fields[4]);
+		iterations.resize(static_cast<std::size_t>(columns) * rows);
+		std::future<void> rendering = std::async(std::launch::async, [&]() {
+			render_block(view, fields[5], fields[6], fields[1], fields[2], columns, rows, &iterations[0], render_pool());
+		});
+		char working[64];
+		snprintf(working, sizeof(working), "WORKING %lld", fields[0]);
+		bool alive = true;
+		while (rendering.wait_for(std::chrono::seconds(farm_keepalive_seconds)) != std::future_status::ready)
+			alive = alive && send_line(s, working);
+		rendering.get();
+		if (!alive)
+			break;
+		pack_iterations(iterations, bytes);
+		char reply[64];
+		snprintf(reply, sizeof(reply), "DONE %lld %lld", fields[0], static_cast<long long>(bytes.size()));
+		if (!send_line(s, reply) || !send_all(s, &bytes[0], bytes.size()))
+			break;
+	}
+	close_socket(s);
+	return 0;
+}
+
+#endif
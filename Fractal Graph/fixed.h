@@ -0,0 +1,258 @@
+#pragma once
+//Fixed point escape kernel: orbits in 128-bit two's complement integers with the binary point placed for the
+//view, which every machine computes bit for bit the same
+#ifndef __FIXED_H__
+#define __FIXED_H__
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER) && defined(_M_X64) && !defined(__SIZEOF_INT128__)
+#include <intrin.h>
+#endif
+#include "render.h"
+
+//A 128-bit two's complement integer in two limbs, read as value / 2^fraction for the fraction bits the caller
+//carries alongside
+struct fixed128 {
+	// REPRESENTATION
+	unsigned long long hi;
+	unsigned long long lo;
+};
+
+//a * b as a full 128-bit product: the low half returned, the high half in high
+unsigned long long multiply_wide(unsigned long long a, unsigned long long b, unsigned long long& high) {
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+	high = static_cast<unsigned long long>(product >> 64);
+	return static_cast<unsigned long long>(product);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	return _umul128(a, b, &high);
+#else
+	//Four 32-bit partial products
+	unsigned long long a0 = a & 0xffffffffull, a1 = a >> 32, b0 = b & 0xffffffffull, b1 = b >> 32;
+	unsigned long long p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+	unsigned long long middle = (p00 >> 32) + (p01 & 0xffffffffull) + (p10 & 0xffffffffull);
+	high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+	return (middle << 32) | (p00 & 0xffffffffull);
+#endif
+}
+
+bool negative(const fixed128& a) {
+	return (a.hi >> 63) != 0;
+}
+
+fixed128 operator+ (const fixed128& a, const fixed128& b) {
+	fixed128 sum;
+	sum.lo = a.lo + b.lo;
+	sum.hi = a.hi + b.hi + (sum.lo < a.lo);
+	return sum;
+}
+
+fixed128 operator- (const fixed128& a) {
+	fixed128 out;
+	out.lo = ~a.lo + 1;
+	out.hi = ~a.hi + (out.lo == 0);
+	return out;
+}
+
+fixed128 operator- (const fixed128& a, const fixed128& b) {
+	return a + -b;
+}
+
+bool operator< (const fixed128& a, const fixed128& b) {
+	return static_cast<long long>(a.hi) < static_cast<long long>(b.hi) || (a.hi == b.hi && a.lo < b.lo);
+}
+
+bool operator== (const fixed128& a, const fixed128& b) {
+	return a.hi == b.hi && a.lo == b.lo;
+}
+
+fixed128 absolute(const fixed128& a) {
+	return negative(a) ? -a : a;
+}
+
+//a * b with fraction bits after the binary point, truncated toward zero, so -a * b is exactly -(a * b). The
+//result must fit, which fixed_fraction_bits sees to.
+fixed128 fixed_multiply(const fixed128& a, const fixed128& b, int fraction) {
+	bool flip = negative(a) != negative(b);
+	fixed128 x = absolute(a), y = absolute(b);
+	//The 256-bit product in four limbs, least significant first
+	unsigned long long limbs[4], high, carry;
+	limbs[0] = multiply_wide(x.lo, y.lo, limbs[1]);
+	unsigned long long cross = multiply_wide(x.lo, y.hi, high);
+	limbs[1] += cross;
+	carry = (limbs[1] < cross);
+	limbs[2] = high + carry;
+	limbs[3] = (limbs[2] < carry);
+	cross = multiply_wide(x.hi, y.lo, high);
+	limbs[1] += cross;
+	carry = (limbs[1] < cross);
+	limbs[2] += carry;
+	limbs[3] += (limbs[2] < carry);
+	limbs[2] += high;
+	limbs[3] += (limbs[2] < high);
+	cross = multiply_wide(x.hi, y.hi, high);
+	limbs[2] += cross;
+	limbs[3] += (limbs[2] < cross) + high;
+	//Bits fraction to fraction + 127; fraction is under 128, so limb + 2 is still a limb
+	int limb = fraction / 64, shift = fraction % 64;
+	fixed128 out;
+	if (shift == 0) {
+		out.lo = limbs[limb];
+		out.hi = limbs[limb + 1];
+	}
+	else {
+		out.lo = (limbs[limb] >> shift) | (limbs[limb + 1] << (64 - shift));
+		out.hi = (limbs[limb + 1] >> shift) | (limbs[limb + 2] << (64 - shift));
+	}
+	return flip ? -out : out;
+}
+
+//The fixed point number nearest below |value| * 2^fraction in size, with value's sign
+fixed128 to_fixed(long double value, int fraction) {
+	long double scaled = ldexpl(fabsl(value), fraction - 64);
+	long double top = floorl(scaled);
+	fixed128 out;
+	out.hi = static_cast<unsigned long long>(top);
+	out.lo = static_cast<unsigned long long>(ldexpl(scaled - top, 64));
+	return (value < 0) ? -out : out;
+}
+
+//Exact for both halves, so a double-double point keeps all the bits the fraction has room for
+fixed128 to_fixed(const double_double& value, int fraction) {
+	return to_fixed(static_cast<long double>(value.hi), fraction) + to_fixed(static_cast<long double>(value.lo), fraction);
+}
+
+long double from_fixed(const fixed128& a, int fraction) {
+	fixed128 size = absolute(a);
+	long double value = ldexpl(static_cast<long double>(size.hi), 64 - fraction) + ldexpl(static_cast<long double>(size.lo), -fraction);
+	return negative(a) ? -value : value;
+}
+
+//Fraction bits for orbits of fractal type whose points and constant have no part larger than reach: as many as
+//leave room, with the sign, for the largest norm a step can reach from inside the escape radius
+int fixed_fraction_bits(int type, long double reach, long double threshold) {
+	long double power = (type % 4 == 3) ? 3.0 : 2.0;
+	long double largest = powl(threshold, power) + 2 * std::max(reach, threshold);
+	int whole = static_cast<int>(ceill(log2l(2 * largest * largest))) + 1;
+	return 127 - std::max(whole, 1);
+}
+
+struct fixed_complex {
+	fixed128 real;
+	fixed128 imaginary;
+};
+
+//escape(type, start, point, threshold, depth) in fixed point, with fraction bits. The squares the bailout test
+//takes are the ones the next step uses. An orbit that comes back exactly to where it was at the last power of
+//two steps repeats forever and is stopped as interior: in fixed point attracting cycles get there, and the
+//test involves no rounding that could differ between machines.
+std::pair<bool, int> escape_fixed(int type, const fixed_complex& start, const fixed_complex& point, const fixed128& limit, int depth, int fraction) {
+	type %= 4;
+	bool julia = type >= 2;
+	fixed_complex z = julia ? point : start;
+	const fixed_complex& k = julia ? start : point;
+	fixed_complex saved = z;
+	int i = 0, next_save = 8;
+	for (;; ++i) {
+		fixed128 xx = fixed_multiply(z.real, z.real, fraction), yy = fixed_multiply(z.imaginary, z.imaginary, fraction);
+		fixed128 norm = xx + yy;
+		if (!(norm < limit) || i == depth) {
+			bool escaped = julia ? limit < norm : !(norm < limit);
+			return escaped ? std::make_pair(true, depth - i) : std::make_pair(false, 0);
+		}
+		fixed_complex next;
+		switch (type) {
+		case 1: {
+			fixed128 xy = fixed_multiply(absolute(z.real), absolute(z.imaginary), fraction);
+			next.real = xx - yy + k.real;
+			next.imaginary = xy + xy + k.imaginary;
+			break;
+		}
+		case 3: {
+			fixed128 xy = fixed_multiply(z.real, z.imaginary, fraction);
+			fixed128 square_real = xx - yy, square_imaginary = xy + xy;
+			next.real = fixed_multiply(square_real, z.real, fraction) - fixed_multiply(square_imaginary, z.imaginary, fraction) + k.real;
+			next.imaginary = fixed_multiply(square_imaginary, z.real, fraction) + fixed_multiply(square_real, z.imaginary, fraction) + k.imaginary;
+			break;
+		}
+		default: {
+			fixed128 xy = fixed_multiply(z.real, z.imaginary, fraction);
+			next.real = xx - yy + k.real;
+			next.imaginary = xy + xy + k.imaginary;
+		}
+		}
+		z = next;
+		if (z.real == saved.real && z.imaginary == saved.imaginary)
+			return std::make_pair(false, 0);
+		if (i + 1 == next_save) {
+			saved = z;
+			next_save *= 2;
+		}
+	}
+}
+
+//Fill the columns x rows block at (column0, row0) of a width x height image like render_block, every pixel
+//through escape_fixed with the pixel points taken in double-double
+void render_block_fixed(const fractal_view& view, long long width, long long height, long long column0, long long row0, int columns, int rows, int* out, thread_pool& pool) {
+	int fraction = fixed_fraction_bits(view.fractal_type, view_reach(view), escape_threshold);
+	fixed_complex start;
+	start.real = to_fixed(view.starting_point.real, fraction);
+	start.imaginary = to_fixed(view.starting_point.imaginary, fraction);
+	fixed128 threshold = to_fixed(escape_threshold, fraction);
+	fixed128 limit = fixed_multiply(threshold, threshold, fraction);
+	pool.parallel_for(0, rows, [&](int i) {
+		for (int j = 0; j < columns; ++j) {
+			cdouble_double dot = deep_pixel_point(view, column0 + j, row0 + i, width, height);
+			fixed_complex point;
+			point.real = to_fixed(dot.real, fraction);
+			point.imaginary = to_fixed(dot.imaginary, fraction);
+			std::pair<bool, int> eval = escape_fixed(view.fractal_type, start, point, limit, view.maxiterations, fraction);
+			out[static_cast<std::size_t>(i) * columns + j] = eval.first ? eval.second : interior;
+		}
+	});
+}
+
+//Entry point for "--bench-fixed <width> <height> [view options]": time mandelbrot() and the fixed point kernel
+//on every pixel of the view, one thread each, and count the pixels where they disagree
+int fixed_benchmark_main(int argc, char** argv, const fractal_view& defaults) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: --bench-fixed <width> <height> [--view=xmin,xmax,ymin,ymax] [--type=n] [--iter=n] [--start=re,im]\n");
+		return 1;
+	}
+	fractal_view view = defaults;
+	long long width = atoll(argv[0]), height = atoll(argv[1]);
+	for (int a = 2; a < argc; ++a)
+		if (!parse_view_option(argv[a], view)) {
+			fprintf(stderr, "bench-fixed: unknown option %s\n", argv[a]);
+			return 1;
+		}
+	if (width <= 0 || height <= 0 || view.maxiterations <= 0) {
+		fprintf(stderr, "bench-fixed: width, height and iterations must be positive\n");
+		return 1;
+	}
+	std::size_t pixels = static_cast<std::size_t>(width) * height;
+	std::vector<int> floating(pixels), fixed(pixels);
+	fractal_type = view.fractal_type;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (long long i = 0; i < height; ++i)
+		for (long long j = 0; j < width; ++j) {
+			std::pair<bool, int> eval = mandelbrot(view.starting_point, pixel_point(view, j, i, width, height), escape_threshold, view.maxiterations);
+			floating[static_cast<std::size_t>(i) * width + j] = eval.first ? eval.second : interior;
+		}
+	std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+	thread_pool single(1);
+	render_block_fixed(view, width, height, 0, 0, static_cast<int>(width), static_cast<int>(height), &fixed[0], single);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	long long differing = 0;
+	for (std::size_t p = 0; p < pixels; ++p)
+		differing += floating[p] != fixed[p];
+	printf("mandelbrot(): %.3f s\nfixed point: %.3f s\ndiffering pixels: %lld of %lld\n",
+		std::chrono::duration<double>(middle - begin).count(), std::chrono::duration<double>(end - middle).count(), differing, static_cast<long long>(pixels));
+	return 0;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+//Navigation history: the views visited, each with its finished frame kept compressed for going back to
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+#include <deque>
+#include <string>
+#include <vector>
+#include "render.h"
+#include "varint.h"
+
+//One visited view and the frame it finished with
+struct history_entry {
+	fractal_view view;
+	int width;
+	int height;
+	std::string packed;
+};
+
+//Browser-style back/forward over finished frames. Visiting a new view drops everything forward of the current
+//entry; the oldest entries go once there are too many or their frames outgrow the byte budget.
+class view_history {
+public:
+	view_history(std::size_t capacity_, std::size_t budget_) : capacity(capacity_), budget(budget_) { current = -1; used = 0; }
+	//Record a finished frame of view; a frame of the view already current just replaces its buffer
+	void visit(const fractal_view& view, int width, int height, const int* iterations) {
+		history_entry entry;
+		entry.view = view;
+		entry.width = width;
+		entry.height = height;
+		compress_iterations(iterations, static_cast<std::size_t>(width) * height, entry.packed);
+		if (current >= 0 && same_view(entries[current].view, view)) {
+			used -= entries[current].packed.size();
+			used += entry.packed.size();
+			entries[current].packed.swap(entry.packed);
+			entries[current].width = width;
+			entries[current].height = height;
+		}
+		else {
+			while (static_cast<int>(entries.size()) > current + 1) {
+				used -= entries.back().packed.size();
+				entries.pop_back();
+			}
+			used += entry.packed.size();
+			entries.push_back(entry);
+			current = static_cast<int>(entries.size()) - 1;
+		}
+		while (entries.size() > 1 && (entries.size() > capacity || used > budget) && current > 0) {
+			used -= entries.front().packed.size();
+			entries.pop_front();
+			--current;
+		}
+	}
+	bool can_go(int step) const {
+		return current + step >= 0 && current + step < static_cast<int>(entries.size());
+	}
+	//Move step entries back (negative) or forward (positive); returns the entry now current, or NULL at an end
+	const history_entry* go(int step) {
+		if (!can_go(step))
+			return NULL;
+		current += step;
+		return &entries[current];
+	}
+	//Unpack an entry's frame into iterations
+	static bool restore(const history_entry& entry, std::vector<int>& iterations) {
+		iterations.resize(static_cast<std::size_t>(entry.width) * entry.height);
+		const unsigned char* pos = reinterpret_cast<const unsigned char*>(entry.packed.data());
+		return expand_iterations(pos, pos + entry.packed.size(), iterations.data(), iterations.size());
+	}
+private:
+	// REPRESENTATION
+	std::deque<history_entry> entries;
+	int current;
+	std::size_t capacity;
+	std::size_t budget;
+	std::size_t used;
+};
+
+#endif
@@ -1,5 +1,9 @@
 /* Main source file for Glimmer */
 
+//Keep <Windows.h> from defining min/max macros and from dragging in the old winsock
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+
 int fractal_type = 0;
 
 #include <algorithm>
@@ -12,6 +16,21 @@ int fractal_type = 0;
 #include <unordered_map>
 #include <thread>
 #include "complex.h"
+#include "animation.h"
+#include "distance.h"
+#include "expmap.h"
+#include "farm.h"
+#include "fixed.h"
+#include "history.h"
+#include "poster.h"
+#include "prefetch.h"
+#include "session.h"
+#include "pyramid.h"
+#include "scanlines.h"
+#include "thumbnails.h"
+#include "tileserver.h"
+#include "tiles.h"
+#include "tilestore.h"
 
 long double VAR = 0.01;
 
@@ -32,10 +51,10 @@ clong_double starting_point(0.0, 0.0);
 
 unsigned int samplingResolution = 20000;
 
-long double xmin = -2.0;
-long double xmax = 1.0;
-long double ymax = 1.0;
-long double ymin = -1.0;
+double_double xmin = -2.0;
+double_double xmax = 1.0;
+double_double ymax = 1.0;
+double_double ymin = -1.0;
 
 //Cyclic
 const gradient rainbow = {
@@ -108,14 +127,22 @@ int currentscheme = 0;
 
 bool samplerender = true;
 
+//Exhaustive frames show distance to the set ('d') instead of iteration counts, where there is an estimate
+bool distancerender = false;
+
 //Some globals
 int windowHeight = 10;
 int windowWidth = 10;
+//The window size the view's bounds were laid out for, or 0 before the window first has a size
+int viewWidth = 0;
+int viewHeight = 0;
 
 bool ctrlDown = false;
 
-//Remember numbers that ARE part of the set
-std::unordered_map<long double, std::vector<long double>> knownmembers;
+//Remember spans of scanlines that ARE part of the set, for both render modes. Pixels it answers for are guessed,
+//and now and then guessed wrong, so it is only consulted when started with --guess-interior.
+scanline_cache knownmembers(64u << 20);
+bool guess_interior = false;
 
 //The gradients available to this session
 std::vector<gradient> gradientSet = {
@@ -125,13 +152,114 @@ std::vector<gradient> gradientSet = {
 //Contains pre-compiled GPU instructions for changing to the right color given a particular integer
 std::vector<std::vector<GLuint>> compiled_gradients;
 
+//The same gradients as packed RGB, for colouring whole frames at once
+std::vector<std::vector<unsigned char>> frame_palettes;
+
+//Exhaustively rendered tiles, kept so that returning to a view does not recompute it
+tile_cache view_tiles(256u << 20);
+
+//Tiles on disk shared with other sessions and batch renders, when started with --store=path
+tile_store disk_tiles;
+tile_backing* view_backing = NULL;
+
+//Fills view_tiles while the app is idle, with the tiles the next move is most likely to need; started only
+//once main knows the session is interactive, so headless modes never spawn its workers
+std::unique_ptr<tile_prefetcher> prefetcher;
+navigation_trend trend;
+
+//Finished exhaustive frames at halving resolutions, for previewing a zoom out
+iteration_pyramid zoom_pyramid(64u << 20);
+
+//Views with finished frames, for going back and forward with '[' and ']'
+view_history visited(100, 64u << 20);
+
+//The last exhaustive frame: iteration counts and their colours, windowWidth x windowHeight, top row first
+std::vector<int> frame_iterations;
+std::vector<unsigned char> frame_rgb;
+//The view frame_iterations shows
+fractal_view frame_view;
+//After a resize, which pixels of frame_iterations are known and where the others are; empty once all are
+std::vector<unsigned char> frame_known;
+frame_placement frame_place;
+//The scheme frame_rgb was coloured with
+int frame_scheme = -1;
+//Whether frame_iterations holds distance shades rather than iteration values
+bool frame_distance = false;
+//Whether frame_iterations is a preview pieced together from other frames rather than a rendered frame of
+//frame_view; it is shown, but never presented again or saved as the view's frame
+bool frame_provisional = false;
+
+//Pixels of the window sampled so far, at their lattice centers, for the exhaustive render to skip
+sampled_frame samples;
+
+//Where the session is saved on exit and restored from on launch
+std::string session_path = "session.fractal";
+//Set while the frame restored from the last session has yet to be shown
+bool frame_restored = false;
+
+
+//The session's current view, for handing to the window-free renderers
+fractal_view current_view() {
+	fractal_view view;
+	view.xmin = xmin;
+	view.xmax = xmax;
+	view.ymin = ymin;
+	view.ymax = ymax;
+	view.fractal_type = fractal_type;
+	view.starting_point = starting_point;
+	view.maxiterations = maxiterations;
+	return view;
+}
 
 void ClearScreen() { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); }/* Main source file for Glimmer */
 
+//Fit the view to a resized window. Every resize after the first grows or shrinks the view from its top-left
+//corner at the same pixel size; the first only says what size the view was meant for. If there is a frame of
+//the view, every pixel still inside the window is kept as it is and only the new ones are left to compute. A
+//frame restored from the last session is not resized but waits for its own window size, and the view goes back
+//to it there unless it has been moved since.
+void resize_frame() {
+	int old_width = viewWidth, old_height = viewHeight;
+	if (windowWidth <= 0 || windowHeight <= 0)
+		return;
+	viewWidth = windowWidth;
+	viewHeight = windowHeight;
+	fractal_view old_view = current_view();
+	if (frame_restored && frame_iterations.size() == static_cast<std::size_t>(windowWidth) * windowHeight && same_fractal(frame_view, old_view)
+		&& frame_view.xmin == xmin && frame_view.ymin == ymin) {
+		xmax = frame_view.xmax;
+		ymax = frame_view.ymax;
+		return;
+	}
+	if (old_width <= 0 || old_height <= 0 || (old_width == windowWidth && old_height == windowHeight))
+		return;
+	long double pixel_x = static_cast<long double>(xmax - xmin) / old_width, pixel_y = static_cast<long double>(ymax - ymin) / old_height;
+	xmax = xmin + double_double(pixel_x * windowWidth);
+	ymax = ymin + double_double(pixel_y * windowHeight);
+	if (frame_restored || frame_distance || frame_iterations.size() != static_cast<std::size_t>(old_width) * old_height || !same_view(frame_view, old_view))
+		return;
+	frame_place = place_frame(old_view, old_width, old_height);
+	frame_place.width = windowWidth;
+	frame_place.height = windowHeight;
+	std::vector<int> resized(static_cast<std::size_t>(windowWidth) * windowHeight, interior);
+	std::vector<unsigned char> known(resized.size(), 0);
+	for (int i = 0; i < std::min(old_height, windowHeight); ++i)
+		for (int j = 0; j < std::min(old_width, windowWidth); ++j) {
+			std::size_t from = static_cast<std::size_t>(i) * old_width + j, to = static_cast<std::size_t>(i) * windowWidth + j;
+			resized[to] = frame_iterations[from];
+			known[to] = frame_known.empty() ? 1 : frame_known[from];
+		}
+	frame_iterations.swap(resized);
+	frame_known.swap(known);
+	frame_view = current_view();
+}
+
 //Callback for when the window changes size
 void changeSize(int width, int height) {
+	prefetcher->pause();
 	windowHeight = height;
 	windowWidth = width;
+	resize_frame();
 	//To avoid divide by zero:
 	if (height == 0)
 		height = 1;
@@ -167,6 +295,9 @@ void recompile_gradients() {
 			glEndList();
 		}
 	}
+	frame_palettes.resize(gradientSet.size());
+	for (unsigned int i = 0; i < gradientSet.size(); ++i)
+		frame_palettes[i] = build_palette(gradientSet[i], maxiterations, moddenom);
 }
 
  /* Initialize OpenGL Graphics */
@@ -192,8 +323,215 @@ void initGL() {
 //}
 
 
+//The view an arrow key moves to: a quarter of the view times speed in that direction
+fractal_view panned_view(fractal_view view, int key) {
+	long double xdiff = view_width(view);
+	long double ydiff = view_height(view);
+	switch (key) {
+	case GLUT_KEY_UP:
+		view.ymin -= ydiff / 4.0 * speed;
+		view.ymax -= ydiff / 4.0 * speed;
+		break;
+	case GLUT_KEY_DOWN:
+		view.ymin += ydiff / 4.0 * speed;
+		view.ymax += ydiff / 4.0 * speed;
+		break;
+	case GLUT_KEY_RIGHT:
+		view.xmin += xdiff / 4.0 * speed;
+		view.xmax += xdiff / 4.0 * speed;
+		break;
+	case GLUT_KEY_LEFT:
+		view.xmin -= xdiff / 4.0 * speed;
+		view.xmax -= xdiff / 4.0 * speed;
+		break;
+	}
+	return view;
+}
+
+//The view 'w' (in) or 's' (out) zooms to: half or five thirds the size about the same center
+fractal_view zoomed_view(fractal_view view, bool in) {
+	long double zc = 0.75f;
+	long double scale = in ? zc : 1 / zc;
+	long double xdiff = view_width(view);
+	long double ydiff = view_height(view);
+	double_double old = view.xmin;
+	view.xmin = view.xmax - xdiff * scale;
+	view.xmax = old + xdiff * scale;
+	old = view.ymin;
+	view.ymin = view.ymax - ydiff * scale;
+	view.ymax = old + ydiff * scale;
+	return view;
+}
+
+//Queue for the prefetcher the tiles of this view, then of every move from it, likeliest move first
+void schedule_prefetch() {
+	static const int arrows[4] = { GLUT_KEY_UP, GLUT_KEY_DOWN, GLUT_KEY_LEFT, GLUT_KEY_RIGHT };
+	fractal_view view = current_view();
+	std::vector<tile_key> keys;
+	missing_tiles(view, windowWidth, windowHeight, view_tiles, keys);
+	std::vector<navigation_move> moves = trend.ranked();
+	for (std::size_t k = 0; k < moves.size(); ++k) {
+		if (moves[k] == move_in || moves[k] == move_out)
+			missing_tiles(zoomed_view(view, moves[k] == move_in), windowWidth, windowHeight, view_tiles, keys);
+		else
+			missing_tiles(panned_view(view, arrows[moves[k]]), windowWidth, windowHeight, view_tiles, keys);
+	}
+	prefetcher->schedule(keys);
+}
+
+//Fill frame_iterations for the whole window, taking every tile it can from view_tiles, or with distance shades
+void render_frame() {
+	fractal_view view = current_view();
+	frame_iterations.resize(static_cast<std::size_t>(windowWidth) * windowHeight);
+	if (frame_iterations.empty())
+		return;
+	frame_view = view;
+	frame_known.clear();
+	frame_provisional = false;
+	frame_distance = distancerender && render_distance(view, windowWidth, windowHeight, &frame_iterations[0], render_pool()) >= 0;
+	if (frame_distance)
+		return;
+	lattice_frame frame;
+	if (snap_to_lattice(view, windowWidth, windowHeight, frame))
+		render_tiles(view, frame, view_tiles, &frame_iterations[0], render_pool(), view_backing,
+			(same_view(samples.view, view) && samples.frame.width == windowWidth && samples.frame.height == windowHeight) ? &samples : NULL,
+			guess_interior ? &knownmembers : NULL);
+	else
+		render_rows(view, windowWidth, windowHeight, 0, windowHeight, &frame_iterations[0], render_pool());
+	zoom_pyramid.add(view, place_frame(view, windowWidth, windowHeight), &frame_iterations[0]);
+	visited.visit(view, windowWidth, windowHeight, &frame_iterations[0]);
+}
+
+//Colour frame_iterations with the current scheme and draw it over the whole window; without recolor the colours
+//from last time are drawn again if they are still of this scheme
+void present_frame(bool recolor = true) {
+	if (frame_iterations.empty() || frame_iterations.size() != static_cast<std::size_t>(windowWidth) * windowHeight)
+		return;
+	if (recolor || frame_scheme != currentscheme || frame_rgb.size() != 3 * frame_iterations.size()) {
+		frame_rgb.resize(3 * frame_iterations.size());
+		if (frame_distance)
+			colorize(&frame_iterations[0], frame_iterations.size(), build_palette(gradientSet[currentscheme], distance_shades - 1, distance_shades), &frame_rgb[0]);
+		else
+			colorize(&frame_iterations[0], frame_iterations.size(), frame_palettes[currentscheme], &frame_rgb[0]);
+		frame_scheme = currentscheme;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glRasterPos2i(0, 0);
+	glPixelZoom(1.0f, -1.0f);
+	glDrawPixels(windowWidth, windowHeight, GL_RGB, GL_UNSIGNED_BYTE, &frame_rgb[0]);
+}
+
+//Show the current view at once from what earlier, finer frames already know, then compute the margin they
+//leave uncovered through the view's tiles, which the exhaustive render then finds cached. The preview stays
+//provisional until that render replaces it. Does nothing if no earlier frame covers any of it.
+void preview_frame() {
+	fractal_view view = current_view();
+	frame_placement place = place_frame(view, windowWidth, windowHeight);
+	std::vector<int> preview(static_cast<std::size_t>(windowWidth) * windowHeight, interior);
+	std::vector<unsigned char> known;
+	if (preview.empty() || zoom_pyramid.preview(view, place, &preview[0], known) == 0)
+		return;
+	frame_iterations.swap(preview);
+	frame_distance = false;
+	frame_provisional = true;
+	frame_view = view;
+	frame_known.clear();
+	present_frame();
+	glFlush();
+	fill_margin(view, place, &frame_iterations[0], known, view_tiles, view_backing, render_pool());
+	present_frame();
+}
+
+//Step back (negative) or forward through the history, showing the frame it kept instead of rendering again
+void revisit(int step) {
+	const history_entry* entry = visited.go(step);
+	if (!entry)
+		return;
+	xmin = entry->view.xmin;
+	xmax = entry->view.xmax;
+	ymin = entry->view.ymin;
+	ymax = entry->view.ymax;
+	fractal_type = entry->view.fractal_type;
+	starting_point = entry->view.starting_point;
+	if (maxiterations != entry->view.maxiterations) {
+		maxiterations = entry->view.maxiterations;
+		recompile_gradients();
+	}
+	ClearScreen();
+	//A frame kept at another window size cannot be shown as it is
+	if (entry->width != windowWidth || entry->height != windowHeight || !view_history::restore(*entry, frame_iterations))
+		render_frame();
+	else
+		frame_distance = false;
+	frame_provisional = false;
+	frame_view = current_view();
+	frame_known.clear();
+	present_frame();
+	glutSwapBuffers();
+}
+
+//Save the view, settings and the frame on screen, if it is still of this view, for the next launch
+void save_session() {
+	session_state state;
+	state.view = current_view();
+	state.scheme = currentscheme;
+	state.moddenom = moddenom;
+	state.speed = speed;
+	state.sampling = samplingResolution;
+	state.point_size = pointSize;
+	state.width = windowWidth;
+	state.height = windowHeight;
+	if (same_view(frame_view, state.view) && frame_known.empty() && !frame_distance && !frame_provisional && frame_iterations.size() == static_cast<std::size_t>(windowWidth) * windowHeight)
+		state.iterations = frame_iterations;
+	if (!save_session(session_path, state))
+		fprintf(stderr, "cannot save session to %s\n", session_path.c_str());
+}
+
+//Pick up where the last session left off; its frame is shown on the first redraw at the same window size
+void restore_session() {
+	session_state state;
+	if (!load_session(session_path, state))
+		return;
+	xmin = state.view.xmin;
+	xmax = state.view.xmax;
+	ymin = state.view.ymin;
+	ymax = state.view.ymax;
+	fractal_type = state.view.fractal_type;
+	starting_point = state.view.starting_point;
+	maxiterations = state.view.maxiterations;
+	currentscheme = state.scheme % gradientSet.size();
+	moddenom = state.moddenom;
+	speed = state.speed;
+	samplingResolution = static_cast<unsigned int>(state.sampling);
+	pointSize = state.point_size;
+	//The view was laid out for the last session's window, where its frame was kept
+	viewWidth = state.width;
+	viewHeight = state.height;
+	if (!state.iterations.empty()) {
+		frame_iterations.swap(state.iterations);
+		frame_view = state.view;
+		frame_provisional = false;
+		frame_restored = true;
+	}
+}
+
+//Show the last session's frame in place of a sampled one, if the view and window still match it; the
+//prefetcher then refines the view's tiles in the background
+bool show_restored_frame() {
+	if (!frame_restored || !same_view(frame_view, current_view()))
+		return false;
+	if (frame_iterations.size() != static_cast<std::size_t>(windowWidth) * windowHeight)
+		return false;
+	frame_restored = false;
+	present_frame();
+	glutSwapBuffers();
+	schedule_prefetch();
+	return true;
+}
+
 //Contains all gl-code; there should be no need to have any outside of this function
 void renderScene(void) {
+	prefetcher->pause();
 	//Screen-cleanup
 	// Clear Color and Depth Buffers
 	// Reset transformations
@@ -207,56 +545,14 @@ void renderScene(void) {
 	std::pair<bool, int> eval;
 	long double ratio = 1.0 * windowWidth / windowHeight;
 	long double threshold = 2.0;
+	if (samplerender && show_restored_frame())
+		return;
 	if (!samplerender) {
-		//ClearScreen();
-		glPointSize(1.0f);
-		glBegin(GL_POINTS);
-		for (unsigned int i = 0; i < windowHeight; ++i) {
-			dot.imaginary = (long double(i) / long double(windowHeight)) * (ymax - ymin) + ymin; //* (((ypan - defaultViewportSize) / zoom), ((ypan + defaultViewportSize) / zoom));
-			//auto data_exists = knownmembers.find(dot.imaginary);
-			//int prev = -1;
-			for (unsigned int j = 0; j < windowWidth; ++j) {
-				dot.real = (long double(j) / long double(windowWidth)) * (xmax - xmin) + xmin; //* ((xpan - defaultViewportSize * ratio) / zoom, (xpan + defaultViewportSize * ratio) / zoom);
-				//if (data_exists != knownmembers.end()) {
-				//	for (unsigned int q = 0; q < data_exists->second.size(); ++q) {
-				//		//On even-numbered cells (0 being odd and 1 being even),
-				//		if (q % 2) {
-				//			if (data_exists->second[q - 1] < dot.real && dot.real < data_exists->second[q]) {
-				//				eval.first = false;
-				//				break;
-				//				//Technically also eval.second = 0
-				//			}
-				//		}
-				//	}
-				//}
-				//else
-					eval = mandelbrot(starting_point, dot, threshold, maxiterations);
-				if (eval.first) {
-					//fgr::setcolor(mapgradient(long double(eval.second) / long double(maxiterations), cyanic));
-					//fgr::setcolor(mapgradient(fmodl(long double(eval.second), 100.0l) / 100.0l, gradientSet[currentscheme]));
-					glCallList(compiled_gradients[currentscheme][eval.second]);
-					glVertex2i(j, i);
-				}
-				//if (prev != -1) {
-				//	if (eval.second == 0) {
-				//		if (prev != 0) {
-				//			knownmembers[dot.imaginary].push_back(dot.real);
-				//		}
-				//	}
-				//	else {
-				//		if (prev == 0) {
-				//			knownmembers[dot.imaginary].push_back(dot.real);
-				//		}
-				//	}
-				//}
-				//prev = eval.second;
-			}
-			//if (i * 64 % windowHeight == 0) {
-				glEnd();
-				glutSwapBuffers();
-				glBegin(GL_POINTS);
-			//}
-		}
+		render_frame();
+		present_frame();
+		glutSwapBuffers();
+		schedule_prefetch();
+		return;
 	}
 	else {
 		glAlphaFunc(GL_NOTEQUAL, 0);
@@ -265,13 +561,28 @@ void renderScene(void) {
 		glEnable(GL_POINT_SMOOTH);
 		glPointSize(pointSize);
 		glBegin(GL_POINTS);
-		for (unsigned int s = 0; s < samplingResolution; ++s) {
+		//On the lattice every sample is a whole pixel, evaluated at its center and kept for the exhaustive render
+		lattice_frame frame;
+		if (snap_to_lattice(current_view(), windowWidth, windowHeight, frame)) {
+			if (!same_view(samples.view, current_view()) || samples.frame.width != windowWidth || samples.frame.height != windowHeight)
+				reset_samples(samples, current_view(), frame);
+			for (unsigned int s = 0; s < samplingResolution; ++s) {
+				int i = std::min(windowHeight - 1, static_cast<int>(randomFloat(0.0, windowHeight)));
+				int j = std::min(windowWidth - 1, static_cast<int>(randomFloat(0.0, windowWidth)));
+				int value = sample_pixel(samples, j, i, guess_interior ? &knownmembers : NULL);
+				if (value != interior) {
+					glCallList(compiled_gradients[currentscheme][value]);
+					glVertex2f(j + 0.5f, i + 0.5f);
+				}
+			}
+		}
+		else for (unsigned int s = 0; s < samplingResolution; ++s) {
 			long double i = randomFloat(0.0, windowHeight);
 			long double j = randomFloat(0.0, windowWidth);
 			//dot.real = randomFloat((xpan - defaultViewportSize * ratio) / zoom, (xpan + defaultViewportSize * ratio) / zoom);
 			//dot.imaginary = randomFloat(((ypan - defaultViewportSize) / zoom), ((ypan + defaultViewportSize) / zoom));
-			dot.real = (long double(j) / long double(windowWidth)) * (xmax - xmin) + xmin; //* ((xpan - defaultViewportSize * ratio) / zoom, (xpan + defaultViewportSize * ratio) / zoom);
-			dot.imaginary = (long double(i) / long double(windowHeight)) * (ymax - ymin) + ymin; //* (((ypan - defaultViewportSize) / zoom), ((ypan + defaultViewportSize) / zoom));
+			dot.real = (long double(j) / long double(windowWidth)) * static_cast<long double>(xmax - xmin) + static_cast<long double>(xmin); //* ((xpan - defaultViewportSize * ratio) / zoom, (xpan + defaultViewportSize * ratio) / zoom);
+			dot.imaginary = (long double(i) / long double(windowHeight)) * static_cast<long double>(ymax - ymin) + static_cast<long double>(ymin); //* (((ypan - defaultViewportSize) / zoom), ((ypan + defaultViewportSize) / zoom));
 			eval = mandelbrot(starting_point, dot, threshold, maxiterations);
 			if (eval.first) {
 				//fgr::setcolor(mapgradient(long double(eval.second) / long double(maxiterations), cyanic));
@@ -292,10 +603,32 @@ void renderScene(void) {
 
 	//This is the function that refreshes the canvas and implements everything we've 'drawn'
 	glutSwapBuffers();
+	schedule_prefetch();
+}
+
+//Display callback for expose and resize: the last frame goes back up as it was, with only the pixels a resize
+//uncovered computed, and the scene is drawn afresh only when there is no finished frame of this view
+void redisplay() {
+	if (frame_restored || frame_provisional || !same_view(frame_view, current_view()) || frame_iterations.size() != static_cast<std::size_t>(windowWidth) * windowHeight) {
+		renderScene();
+		return;
+	}
+	prefetcher->pause();
+	present_frame(false);
+	glutSwapBuffers();
+	if (!frame_known.empty()) {
+		glFlush();
+		fill_margin(frame_view, frame_place, &frame_iterations[0], frame_known, view_tiles, view_backing, render_pool());
+		frame_known.clear();
+		present_frame();
+		glutSwapBuffers();
+	}
+	schedule_prefetch();
 }
 
 //Mouse click handling
 void MouseClick(int button, int state, int x, int y) {
+	prefetcher->pause();
 	int mod = glutGetModifiers();
 	switch (button) {
 	case 3:
@@ -340,24 +673,24 @@ void MouseClick(int button, int state, int x, int y) {
 }
 
 void ProcessSpecialKeys(int key, int x, int y) {
-	long double xdiff = xmax - xmin;
-	long double ydiff = ymax - ymin;
+	prefetcher->pause();
+	fractal_view view = panned_view(current_view(), key);
+	xmin = view.xmin;
+	xmax = view.xmax;
+	ymin = view.ymin;
+	ymax = view.ymax;
 	switch (key) {
 	case GLUT_KEY_UP:
-		ymin -= ydiff / 4.0 * speed;
-		ymax -= ydiff / 4.0 * speed;
+		trend.moved(move_up);
 		break;
 	case GLUT_KEY_DOWN:
-		ymin += ydiff / 4.0 * speed;
-		ymax += ydiff / 4.0 * speed;
+		trend.moved(move_down);
 		break;
 	case GLUT_KEY_RIGHT:
-		xmin += xdiff / 4.0 * speed;
-		xmax += xdiff / 4.0 * speed;
+		trend.moved(move_right);
 		break;
 	case GLUT_KEY_LEFT:
-		xmin -= xdiff / 4.0 * speed;
-		xmax -= xdiff / 4.0 * speed;
+		trend.moved(move_left);
 		break;
 	}
 	ClearScreen();
@@ -366,7 +699,7 @@ void ProcessSpecialKeys(int key, int x, int y) {
 }
 
 void processNormalKeys(unsigned char key, int x, int y) {
-	long double zc = 0.75f;
+	prefetcher->pause();
 	//Reset the complext parameter
 	switch (key) {
 	case '0':
@@ -381,28 +714,25 @@ void processNormalKeys(unsigned char key, int x, int y) {
 		ClearScreen();
 		break;
 	case 'w': {
-		long double xdiff = xmax - xmin;
-		long double ydiff = ymax - ymin;
-		long double old = xmin;
-		xmin = xmax - xdiff * zc;
-		xmax = old + xdiff * zc;
-		old = ymin;
-		ymin = ymax - ydiff * zc;
-		ymax = old + ydiff * zc;
+		fractal_view view = zoomed_view(current_view(), true);
+		xmin = view.xmin;
+		xmax = view.xmax;
+		ymin = view.ymin;
+		ymax = view.ymax;
 	}
+		trend.moved(move_in);
 		ClearScreen();
 		break;
 	case 's': {
-		long double xdiff = xmax - xmin;
-		long double ydiff = ymax - ymin;
-		long double old = xmin;
-		xmin = xmax - xdiff / zc;
-		xmax = old + xdiff / zc;
-		old = ymin;
-		ymin = ymax - ydiff / zc;
-		ymax = old + ydiff / zc;
+		fractal_view view = zoomed_view(current_view(), false);
+		xmin = view.xmin;
+		xmax = view.xmax;
+		ymin = view.ymin;
+		ymax = view.ymax;
 	}
+		trend.moved(move_out);
 		ClearScreen();
+		preview_frame();
 		break;
 	case 'c':
 		currentscheme++;
@@ -419,12 +749,22 @@ void processNormalKeys(unsigned char key, int x, int y) {
 		recompile_gradients();
 		ClearScreen();
 		break;
+	case 'd':
+		distancerender = !distancerender;
+		ClearScreen();
+		break;
 	case ' ':
 		samplerender = !samplerender;
 		ClearScreen();
 		renderScene();
 		samplerender = !samplerender;
 		return;
+	case '[':
+		revisit(-1);
+		return;
+	case ']':
+		revisit(1);
+		return;
 	case 'q':
 		exit(0);
 	case 't':
@@ -475,6 +815,45 @@ int main(int argc, char** argv) {
 	//Initialize random
 	srand(time(NULL));
 
+	//Headless modes never open a window
+	if (argc > 1 && std::string(argv[1]) == "--poster")
+		return poster_main(argc - 2, argv + 2, current_view(), gradientSet, moddenom);
+	if (argc > 1 && std::string(argv[1]) == "--animate")
+		return animation_main(argc - 2, argv + 2, current_view(), gradientSet, moddenom);
+	if (argc > 1 && std::string(argv[1]) == "--expmap")
+		return expmap_main(argc - 2, argv + 2, current_view(), gradientSet, moddenom);
+	if (argc > 1 && std::string(argv[1]) == "--farm")
+		return farm_main(argc - 2, argv + 2, current_view(), gradientSet, moddenom);
+	if (argc > 1 && std::string(argv[1]) == "--farm-worker")
+		return farm_worker_main(argc - 2, argv + 2);
+	if (argc > 1 && std::string(argv[1]) == "--bench-fixed")
+		return fixed_benchmark_main(argc - 2, argv + 2, current_view());
+	if (argc > 1 && std::string(argv[1]) == "--thumbnails")
+		return thumbnails_main(argc - 2, argv + 2, gradientSet, moddenom);
+	if (argc > 1 && std::string(argv[1]) == "--serve")
+		return tileserver_main(argc - 2, argv + 2, current_view(), gradientSet, moddenom);
+
+	prefetcher.reset(new tile_prefetcher(view_tiles));
+
+	//Interactive sessions can keep their tiles on disk between runs
+	for (int a = 1; a < argc; ++a)
+		if (std::string(argv[a]).compare(0, 8, "--store=") == 0) {
+			if (disk_tiles.open(argv[a] + 8)) {
+				view_backing = &disk_tiles;
+				prefetcher->set_backing(view_backing);
+			}
+			else
+				fprintf(stderr, disk_tiles.held() ? "tile store %s is open in another process\n" : "cannot open tile store %s\n", argv[a] + 8);
+		}
+		else if (std::string(argv[a]).compare(0, 10, "--session=") == 0)
+			session_path = argv[a] + 10;
+		else if (std::string(argv[a]) == "--guess-interior")
+			guess_interior = true;
+
+	//Start from the last session and save this one however the program ends
+	restore_session();
+	atexit(save_session);
+
 	//Initialize GLUT
 	glutInit(&argc, argv);
 
@@ -494,7 +873,7 @@ int main(int argc, char** argv) {
 	////glutSetCursor(GLUT_CURSOR_NONE); //Hide the cursor
 
 	//// Display callbacks
-	glutDisplayFunc(renderScene); //Callback for when we refresh
+	glutDisplayFunc(redisplay); //Callback for when we refresh
 	//glutIdleFunc(renderScene);
 	glutReshapeFunc(changeSize); //Callback for when window is resized
 
@@ -0,0 +1,127 @@
+#pragma once
+//Memory-mapped files, shared by the tile store's index and session snapshots
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+#include <cstddef>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//A file mapped into memory: read/write and at least as long as asked for, or read-only as it stands
+class mapped_file {
+public:
+	mapped_file() { view = NULL; length = 0; handle_init(); }
+	~mapped_file() { close(); }
+	//Map path, creating it or growing it with zeros to size bytes if it is shorter
+	bool open(const std::string& path, std::size_t size) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER existing;
+		if (GetFileSizeEx(file, &existing) && static_cast<unsigned long long>(existing.QuadPart) > size)
+			size = static_cast<std::size_t>(existing.QuadPart);
+		unsigned long long wanted = size;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, static_cast<DWORD>(wanted >> 32), static_cast<DWORD>(wanted & 0xFFFFFFFFu), NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		view = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+#else
+		file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (file < 0)
+			return false;
+		struct stat info;
+		if (fstat(file, &info) == 0 && static_cast<std::size_t>(info.st_size) > size)
+			size = static_cast<std::size_t>(info.st_size);
+		else if (ftruncate(file, static_cast<off_t>(size)) != 0) {
+			close();
+			return false;
+		}
+		void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		view = (mapped == MAP_FAILED) ? NULL : static_cast<unsigned char*>(mapped);
+#endif
+		if (!view) {
+			close();
+			return false;
+		}
+		length = size;
+		return true;
+	}
+	//Map an existing, non-empty file read-only, so a file that cannot be written to still opens. The bytes must not
+	//be written through data().
+	bool open_read(const std::string& path) {
+		close();
+		std::size_t size = 0;
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER existing;
+		if (GetFileSizeEx(file, &existing))
+			size = static_cast<std::size_t>(existing.QuadPart);
+		mapping = (size == 0) ? NULL : CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+			view = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size));
+#else
+		file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		if (fstat(file, &info) == 0)
+			size = static_cast<std::size_t>(info.st_size);
+		void* mapped = (size == 0) ? MAP_FAILED : mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		view = (mapped == MAP_FAILED) ? NULL : static_cast<unsigned char*>(mapped);
+#endif
+		if (!view) {
+			close();
+			return false;
+		}
+		length = size;
+		return true;
+	}
+	void close() {
+#ifdef _WIN32
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (view)
+			munmap(view, length);
+		if (file >= 0)
+			::close(file);
+#endif
+		view = NULL;
+		length = 0;
+		handle_init();
+	}
+	unsigned char* data() { return view; }
+	std::size_t size() const { return length; }
+private:
+	// REPRESENTATION
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+	void handle_init() { file = INVALID_HANDLE_VALUE; mapping = NULL; }
+#else
+	int file;
+	void handle_init() { file = -1; }
+#endif
+	unsigned char* view;
+	std::size_t length;
+	mapped_file(const mapped_file&);
+	mapped_file& operator= (const mapped_file&);
+};
+
+#endif
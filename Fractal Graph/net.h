@@ -0,0 +1,197 @@
+#pragma once
+//Thin blocking TCP helpers over winsock or BSD sockets, enough for the tile farm and tile server
+#ifndef __NET_H__
+#define __NET_H__
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_handle;
+const socket_handle no_socket = INVALID_SOCKET;
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int socket_handle;
+const socket_handle no_socket = -1;
+#endif
+
+//Writing to a socket the other end already closed should fail, not kill the process
+#ifdef MSG_NOSIGNAL
+const int send_flags = MSG_NOSIGNAL;
+#else
+const int send_flags = 0;
+#endif
+
+//Winsock has to be started before any socket call; elsewhere this does nothing
+bool net_startup() {
+#ifdef _WIN32
+	static bool started = false;
+	if (!started) {
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+	return started;
+#else
+	return true;
+#endif
+}
+
+void close_socket(socket_handle s) {
+	if (s == no_socket)
+		return;
+#ifdef _WIN32
+	closesocket(s);
+#else
+	close(s);
+#endif
+}
+
+//Stop both directions so a thread blocked in recv on this socket wakes up
+void shutdown_socket(socket_handle s) {
+#ifdef _WIN32
+	shutdown(s, SD_BOTH);
+#else
+	shutdown(s, SHUT_RDWR);
+#endif
+}
+
+//Fail receives that wait longer than this many seconds (0 waits forever)
+void set_receive_timeout(socket_handle s, int seconds) {
+#ifdef _WIN32
+	DWORD timeout = seconds * 1000;
+#else
+	timeval timeout;
+	timeout.tv_sec = seconds;
+	timeout.tv_usec = 0;
+#endif
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+//Listen for connections on every interface, or only on 127.0.0.1; pass port 0 to let the system choose
+socket_handle listen_on(int port, bool loopback_only = false) {
+	if (!net_startup())
+		return no_socket;
+	socket_handle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == no_socket)
+		return no_socket;
+	int reuse = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+	address.sin_port = htons(static_cast<unsigned short>(port));
+	if (bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(s, 64) != 0) {
+		close_socket(s);
+		return no_socket;
+	}
+	return s;
+}
+
+//The port a listening socket actually ended up on
+int local_port(socket_handle s) {
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+	if (getsockname(s, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		return -1;
+	return ntohs(address.sin_port);
+}
+
+//Wait up to milliseconds for a connection; returns no_socket if none arrived
+socket_handle accept_within(socket_handle listener, int milliseconds) {
+	fd_set ready;
+	FD_ZERO(&ready);
+	FD_SET(listener, &ready);
+	timeval timeout;
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_usec = (milliseconds % 1000) * 1000;
+	if (select(static_cast<int>(listener) + 1, &ready, NULL, NULL, &timeout) <= 0)
+		return no_socket;
+	socket_handle s = accept(listener, NULL, NULL);
+	if (s != no_socket) {
+		int nodelay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+	}
+	return s;
+}
+
+//Connect to host:port, trying every address the name resolves to
+socket_handle connect_to(const std::string& host, int port) {
+	if (!net_startup())
+		return no_socket;
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = NULL;
+	char service[16];
+	snprintf(service, sizeof(service), "%d", port);
+	if (getaddrinfo(host.c_str(), service, &hints, &found) != 0)
+		return no_socket;
+	socket_handle s = no_socket;
+	for (addrinfo* a = found; a && s == no_socket; a = a->ai_next) {
+		s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s != no_socket && connect(s, a->ai_addr, static_cast<int>(a->ai_addrlen)) != 0) {
+			close_socket(s);
+			s = no_socket;
+		}
+	}
+	freeaddrinfo(found);
+	return s;
+}
+
+bool send_all(socket_handle s, const void* data, std::size_t length) {
+	const char* pos = static_cast<const char*>(data);
+	while (length > 0) {
+		int sent = send(s, pos, static_cast<int>(std::min<std::size_t>(length, 1 << 20)), send_flags);
+		if (sent <= 0)
+			return false;
+		pos += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+bool send_line(socket_handle s, const std::string& line) {
+	return send_all(s, (line + "\n").data(), line.size() + 1);
+}
+
+bool recv_all(socket_handle s, void* data, std::size_t length) {
+	char* pos = static_cast<char*>(data);
+	while (length > 0) {
+		int got = recv(s, pos, static_cast<int>(std::min<std::size_t>(length, 1 << 20)), 0);
+		if (got <= 0)
+			return false;
+		pos += got;
+		length -= got;
+	}
+	return true;
+}
+
+//Read one '\n'-terminated line (without the terminator); lines longer than limit are an error
+bool recv_line(socket_handle s, std::string& line, std::size_t limit = 4096) {
+	line.clear();
+	char c;
+	while (recv_all(s, &c, 1)) {
+		if (c == '\n') {
+			if (!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			return true;
+		}
+		if (line.size() >= limit)
+			return false;
+		line += c;
+	}
+	return false;
+}
+
+#endif
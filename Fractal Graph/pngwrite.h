@@ -0,0 +1,168 @@
+#pragma once
+//Minimal PNG encoder for 8-bit RGB images: Up-filtered scanlines, deflated with fixed Huffman codes
+#ifndef __PNGWRITE_H__
+#define __PNGWRITE_H__
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//Bits go into the deflate stream least significant first
+class deflate_bits {
+public:
+	deflate_bits(std::string& out_) : out(out_) { buffer = 0; count = 0; }
+	void put(unsigned int bits, int length) {
+		buffer |= bits << count;
+		count += length;
+		while (count >= 8) {
+			out += static_cast<char>(buffer & 0xFF);
+			buffer >>= 8;
+			count -= 8;
+		}
+	}
+	//Huffman codes are defined most significant bit first, so they go in reversed
+	void put_code(unsigned int code, int length) {
+		unsigned int reversed = 0;
+		for (int k = 0; k < length; ++k)
+			reversed |= ((code >> k) & 1) << (length - 1 - k);
+		put(reversed, length);
+	}
+	void flush() {
+		if (count > 0)
+			put(0, 8 - count);
+	}
+private:
+	// REPRESENTATION
+	std::string& out;
+	unsigned int buffer;
+	int count;
+};
+
+//Fixed Huffman code for a literal/length symbol (RFC 1951 section 3.2.6)
+void put_literal(deflate_bits& bits, int symbol) {
+	if (symbol < 144)
+		bits.put_code(0x30 + symbol, 8);
+	else if (symbol < 256)
+		bits.put_code(0x190 + symbol - 144, 9);
+	else if (symbol < 280)
+		bits.put_code(symbol - 256, 7);
+	else
+		bits.put_code(0xC0 + symbol - 280, 8);
+}
+
+//A back-reference of length 3..258 at distance 1..32768
+void put_match(deflate_bits& bits, int length, int distance) {
+	static const int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const int length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const int distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const int distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	int l = 28;
+	while (length_base[l] > length)
+		--l;
+	put_literal(bits, 257 + l);
+	bits.put(length - length_base[l], length_extra[l]);
+	int d = 29;
+	while (distance_base[d] > distance)
+		--d;
+	bits.put_code(d, 5);
+	bits.put(distance - distance_base[d], distance_extra[d]);
+}
+
+//zlib stream of data using greedy matching against the most recent position of each 3-byte prefix
+std::string zlib_compress(const std::string& data) {
+	std::string out("\x78\x01", 2);
+	deflate_bits bits(out);
+	bits.put(1, 1);
+	bits.put(1, 2);
+	std::vector<int> head(1 << 15, -1);
+	std::size_t i = 0;
+	while (i < data.size()) {
+		int length = 0, distance = 0;
+		if (i + 3 <= data.size()) {
+			unsigned int hash = ((static_cast<unsigned char>(data[i]) << 10) ^ (static_cast<unsigned char>(data[i + 1]) << 5) ^ static_cast<unsigned char>(data[i + 2])) & 0x7FFF;
+			int candidate = head[hash];
+			head[hash] = static_cast<int>(i);
+			if (candidate >= 0 && i - candidate <= 32768) {
+				std::size_t limit = std::min<std::size_t>(258, data.size() - i);
+				std::size_t n = 0;
+				while (n < limit && data[candidate + n] == data[i + n])
+					++n;
+				if (n >= 3) {
+					length = static_cast<int>(n);
+					distance = static_cast<int>(i - candidate);
+				}
+			}
+		}
+		if (length) {
+			put_match(bits, length, distance);
+			i += length;
+		}
+		else
+			put_literal(bits, static_cast<unsigned char>(data[i++]));
+	}
+	put_literal(bits, 256);
+	bits.flush();
+	unsigned int a = 1, b = 0;
+	for (std::size_t k = 0; k < data.size(); ++k) {
+		a = (a + static_cast<unsigned char>(data[k])) % 65521;
+		b = (b + a) % 65521;
+	}
+	unsigned int adler = (b << 16) | a;
+	for (int k = 3; k >= 0; --k)
+		out += static_cast<char>((adler >> (8 * k)) & 0xFF);
+	return out;
+}
+
+//CRC-32 lookup table used by PNG chunks
+std::vector<unsigned int> crc_table() {
+	std::vector<unsigned int> table(256);
+	for (unsigned int n = 0; n < 256; ++n) {
+		unsigned int c = n;
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		table[n] = c;
+	}
+	return table;
+}
+
+unsigned int png_crc(const std::string& bytes) {
+	static const std::vector<unsigned int> table = crc_table();
+	unsigned int c = 0xFFFFFFFFu;
+	for (std::size_t k = 0; k < bytes.size(); ++k)
+		c = table[(c ^ static_cast<unsigned char>(bytes[k])) & 0xFF] ^ (c >> 8);
+	return c ^ 0xFFFFFFFFu;
+}
+
+void append_be32(std::string& out, unsigned int value) {
+	for (int k = 3; k >= 0; --k)
+		out += static_cast<char>((value >> (8 * k)) & 0xFF);
+}
+
+void append_chunk(std::string& png, const char* type, const std::string& data) {
+	append_be32(png, static_cast<unsigned int>(data.size()));
+	std::string body = std::string(type, 4) + data;
+	png += body;
+	append_be32(png, png_crc(body));
+}
+
+//Encode packed RGB bytes, top row first, as a PNG file
+std::string encode_png(const unsigned char* rgb, int width, int height) {
+	std::string raw;
+	raw.reserve(static_cast<std::size_t>(width * 3 + 1) * height);
+	for (int i = 0; i < height; ++i) {
+		const unsigned char* row = rgb + static_cast<std::size_t>(i) * width * 3;
+		raw += static_cast<char>(i ? 2 : 0);
+		for (int k = 0; k < width * 3; ++k)
+			raw += static_cast<char>(i ? row[k] - row[k - width * 3] : row[k]);
+	}
+	std::string header;
+	append_be32(header, width);
+	append_be32(header, height);
+	header += std::string("\x08\x02\x00\x00\x00", 5);
+	std::string png("\x89PNG\r\n\x1a\n", 8);
+	append_chunk(png, "IHDR", header);
+	append_chunk(png, "IDAT", zlib_compress(raw));
+	append_chunk(png, "IEND", std::string());
+	return png;
+}
+
+#endif
@@ -0,0 +1,187 @@
+#pragma once
+//Poster mode: renders images far larger than the window in horizontal bands, straight to disk
+#ifndef __POSTER_H__
+#define __POSTER_H__
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "render.h"
+#include "tilestore.h"
+
+//One poster render; the output is a binary PPM filled in band by band
+struct poster_job {
+	fractal_view view;
+	long long width;
+	long long height;
+	//Rows rendered, colored and written per step; this is what bounds memory
+	int band_rows;
+	std::string path;
+	int scheme;
+	//Tile store to reuse and add to, if any; the image is then rendered on the tile lattice
+	std::string store;
+};
+
+//Band height that keeps one band's iterations and colors around 32MB
+int default_band_rows(long long width) {
+	long long rows = (32LL << 20) / (width * (sizeof(int) + 3));
+	return static_cast<int>(std::max(1LL, std::min(256LL, rows)));
+}
+
+//PPM header for the poster; its length fixes where every band lands in the file
+std::string poster_header(const poster_job& job) {
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "P6\n%lld %lld\n255\n", job.width, job.height);
+	return buffer;
+}
+
+//Everything a checkpoint must agree on before its progress may be trusted
+std::string poster_signature(const poster_job& job, long double moddenom) {
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "poster %lld %lld %d %d %La ", job.width, job.height, job.band_rows, job.scheme, moddenom);
+	return buffer + view_to_string(job.view) + (job.store.empty() ? "" : " lattice");
+}
+
+//Checkpoints sit beside the output file
+std::string checkpoint_path(const poster_job& job) {
+	return job.path + ".ckpt";
+}
+
+//Read a checkpoint file; returns the first unfinished band, or -1 if the file is missing or for another job
+long long read_checkpoint(const std::string& path, const std::string& signature) {
+	FILE* file = open_file(path, "rb");
+	if (!file)
+		return -1;
+	char line[1024];
+	long long band = -1;
+	if (fgets(line, sizeof(line), file) && signature + "\n" == line && fgets(line, sizeof(line), file))
+		band = strtoll(line, NULL, 10);
+	fclose(file);
+	return band;
+}
+
+//The band to resume from
+long long load_checkpoint(const poster_job& job, const std::string& signature) {
+	return std::max(0LL, read_checkpoint(checkpoint_path(job), signature));
+}
+
+//Record that every band before next_band is safely in the output file. The checkpoint is written beside the old
+//one and put in its place in one step, so it is always one or the other; false if it could not be.
+bool save_checkpoint(const poster_job& job, const std::string& signature, long long next_band) {
+	std::string path = checkpoint_path(job);
+	FILE* file = open_file(path + ".tmp", "wb");
+	if (!file)
+		return false;
+	bool written = fprintf(file, "%s\n%lld\n", signature.c_str(), next_band) > 0;
+	written = (fclose(file) == 0) && written;
+	if (!written || !replace_file(path + ".tmp", path)) {
+		remove((path + ".tmp").c_str());
+		return false;
+	}
+	return true;
+}
+
+//Render the whole poster, resuming from a matching checkpoint if there is one; returns a process exit code
+int render_poster(const poster_job& job, const gradient& scheme, long double moddenom) {
+	std::string signature = poster_signature(job, moddenom);
+	std::string header = poster_header(job);
+	long long bands = (job.height + job.band_rows - 1) / job.band_rows;
+	long long first = load_checkpoint(job, signature);
+	FILE* out = (first > 0) ? open_file(job.path, "r+b") : NULL;
+	if (!out) {
+		//Start over, allocating the whole file up front so bands can land in any order
+		first = 0;
+		out = open_file(job.path, "w+b");
+		if (!out) {
+			fprintf(stderr, "poster: cannot open %s\n", job.path.c_str());
+			return 1;
+		}
+		fwrite(header.data(), 1, header.size(), out);
+		seek_file(out, header.size() + job.width * job.height * 3 - 1);
+		fputc(0, out);
+	}
+	else
+		fprintf(stderr, "poster: resuming at band %lld of %lld\n", first, bands);
+	tile_store store;
+	tile_cache cache(64u << 20);
+	lattice_frame lattice;
+	bool tiled = false;
+	if (!job.store.empty()) {
+		if (!store.open(job.store)) {
+			fprintf(stderr, store.held() ? "poster: tile store %s is open in another process\n" : "poster: cannot open tile store %s\n", job.store.c_str());
+			fclose(out);
+			return 1;
+		}
+		tiled = job.width <= INT_MAX && job.height <= INT_MAX
+			&& snap_to_lattice(job.view, static_cast<int>(job.width), static_cast<int>(job.height), lattice);
+		if (!tiled)
+			fprintf(stderr, "poster: view too deep for the tile lattice, rendering without the store\n");
+	}
+	std::vector<unsigned char> palette = build_palette(scheme, job.view.maxiterations, moddenom);
+	std::vector<int> iterations(static_cast<std::size_t>(job.width) * job.band_rows);
+	std::vector<unsigned char> rgb(iterations.size() * 3);
+	for (long long b = first; b < bands; ++b) {
+		long long row0 = b * job.band_rows;
+		int rows = static_cast<int>(std::min<long long>(job.band_rows, job.height - row0));
+		std::size_t count = static_cast<std::size_t>(job.width) * rows;
+		if (tiled) {
+			lattice_frame band = lattice;
+			band.y0 += row0;
+			band.height = rows;
+			render_tiles(job.view, band, cache, &iterations[0], render_pool(), &store);
+		}
+		else
+			render_rows(job.view, job.width, job.height, row0, rows, &iterations[0], render_pool());
+		colorize(&iterations[0], count, palette, &rgb[0]);
+		if (!seek_file(out, header.size() + row0 * job.width * 3) || fwrite(&rgb[0], 3, count, out) != count || fflush(out) != 0) {
+			fprintf(stderr, "poster: write failed at band %lld\n", b);
+			fclose(out);
+			return 1;
+		}
+		if (!save_checkpoint(job, signature, b + 1))
+			fprintf(stderr, "poster: cannot save checkpoint %s; a resumed render repeats band %lld\n",
+				checkpoint_path(job).c_str(), b);
+		fprintf(stderr, "poster: band %lld of %lld\n", b + 1, bands);
+	}
+	fclose(out);
+	remove(checkpoint_path(job).c_str());
+	return 0;
+}
+
+//Entry point for "--poster <width> <height> <output.ppm> [--band=rows] [--scheme=n] [view options]"
+int poster_main(int argc, char** argv, const fractal_view& defaults, const std::vector<gradient>& gradients, long double moddenom) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: --poster <width> <height> <output.ppm> [--band=rows] [--scheme=n] [--store=path] [--view=xmin,xmax,ymin,ymax] [--type=n] [--iter=n] [--start=re,im]\n");
+		return 1;
+	}
+	poster_job job;
+	job.view = defaults;
+	job.width = atoll(argv[0]);
+	job.height = atoll(argv[1]);
+	job.path = argv[2];
+	job.band_rows = 0;
+	job.scheme = 0;
+	for (int a = 3; a < argc; ++a) {
+		std::string arg = argv[a];
+		if (arg.compare(0, 7, "--band=") == 0)
+			job.band_rows = atoi(arg.c_str() + 7);
+		else if (arg.compare(0, 9, "--scheme=") == 0)
+			job.scheme = atoi(arg.c_str() + 9);
+		else if (arg.compare(0, 8, "--store=") == 0)
+			job.store = arg.substr(8);
+		else if (!parse_view_option(arg, job.view)) {
+			fprintf(stderr, "poster: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (job.width <= 0 || job.height <= 0 || job.view.maxiterations <= 0) {
+		fprintf(stderr, "poster: width, height and iterations must be positive\n");
+		return 1;
+	}
+	if (job.band_rows <= 0)
+		job.band_rows = default_band_rows(job.width);
+	job.scheme %= gradients.size();
+	return render_poster(job, gradients[job.scheme], moddenom);
+}
+
+#endif
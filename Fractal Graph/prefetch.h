@@ -0,0 +1,165 @@
+#pragma once
+//Speculative prefetch: while the app is idle, low-priority workers render the tiles the next move will need
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#include "tiles.h"
+
+//The moves a prefetch can guess at
+enum navigation_move { move_up, move_down, move_left, move_right, move_in, move_out, navigation_moves };
+
+//How likely each move is, going by the moves made lately: older moves count for half as much at every step
+class navigation_trend {
+public:
+	navigation_trend() { std::fill(weights, weights + navigation_moves, 0.0); }
+	void moved(navigation_move move) {
+		for (int k = 0; k < navigation_moves; ++k)
+			weights[k] /= 2;
+		weights[move] += 1.0;
+	}
+	//Every move, most likely first; moves never made keep their natural order
+	std::vector<navigation_move> ranked() const {
+		std::vector<navigation_move> order;
+		for (int k = 0; k < navigation_moves; ++k)
+			order.push_back(static_cast<navigation_move>(k));
+		std::stable_sort(order.begin(), order.end(), [this](navigation_move a, navigation_move b) { return weights[a] > weights[b]; });
+		return order;
+	}
+private:
+	// REPRESENTATION
+	double weights[navigation_moves];
+};
+
+//Keys of the lattice tiles a width x height window on view needs that are not cached yet, nearest the
+//middle of the window first
+void missing_tiles(const fractal_view& view, int width, int height, tile_cache& cache, std::vector<tile_key>& out) {
+	lattice_frame frame;
+	if (!snap_to_lattice(view, width, height, frame))
+		return;
+	long long tx0 = floor_div(frame.x0, tile_size), tx1 = floor_div(frame.x0 + width - 1, tile_size);
+	long long ty0 = floor_div(frame.y0, tile_size), ty1 = floor_div(frame.y0 + height - 1, tile_size);
+	long long cx = tx0 + tx1, cy = ty0 + ty1;
+	std::vector<std::pair<long long, tile_key> > found;
+	for (long long ty = ty0; ty <= ty1; ++ty)
+		for (long long tx = tx0; tx <= tx1; ++tx) {
+			tile_key key = make_tile_key(view, frame, tx, ty);
+			if (!cache.contains(key))
+				found.push_back(std::make_pair((2 * tx - cx) * (2 * tx - cx) + (2 * ty - cy) * (2 * ty - cy), key));
+		}
+	std::stable_sort(found.begin(), found.end(), [](const std::pair<long long, tile_key>& a, const std::pair<long long, tile_key>& b) { return a.first < b.first; });
+	for (std::size_t k = 0; k < found.size(); ++k)
+		out.push_back(found[k].second);
+}
+
+//Low-priority workers that fill the tile cache from a queue of guesses. Any foreground work should call pause()
+//first: the queue is dropped and tiles in progress are given up within a row.
+class tile_prefetcher {
+public:
+	tile_prefetcher(tile_cache& cache_, unsigned int threads = std::thread::hardware_concurrency()) : cache(cache_) {
+		if (threads == 0)
+			threads = 1;
+		backing = NULL;
+		stopping = false;
+		fetched = 0;
+		for (unsigned int i = 0; i < threads; ++i) {
+			abandon.push_back(std::unique_ptr<std::atomic<bool> >(new std::atomic<bool>(false)));
+			workers.push_back(std::thread(&tile_prefetcher::work, this, i));
+		}
+	}
+	~tile_prefetcher() {
+		{
+			std::lock_guard<std::mutex> lock(guard);
+			stopping = true;
+			drop();
+		}
+		wake.notify_all();
+		for (std::size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+	//Where fetched tiles are also loaded from and saved to
+	void set_backing(tile_backing* backing_) {
+		std::lock_guard<std::mutex> lock(guard);
+		backing = backing_;
+	}
+	//Replace the queue with these tiles, most wanted first
+	void schedule(const std::vector<tile_key>& keys) {
+		{
+			std::lock_guard<std::mutex> lock(guard);
+			drop();
+			queue.assign(keys.begin(), keys.end());
+		}
+		wake.notify_all();
+	}
+	void pause() {
+		std::lock_guard<std::mutex> lock(guard);
+		drop();
+	}
+	//Tiles fetched so far
+	long long count() const { return fetched; }
+private:
+	// REPRESENTATION
+	tile_cache& cache;
+	tile_backing* backing;
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<std::atomic<bool> > > abandon;
+	std::deque<tile_key> queue;
+	std::mutex guard;
+	std::condition_variable wake;
+	bool stopping;
+	std::atomic<long long> fetched;
+	//Empty the queue and tell every worker to give up what it is on; call with guard held
+	void drop() {
+		queue.clear();
+		for (std::size_t i = 0; i < abandon.size(); ++i)
+			*abandon[i] = true;
+	}
+	void work(unsigned int index) {
+#ifdef _WIN32
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#else
+		//On Linux the nice value of the calling thread alone
+		setpriority(PRIO_PROCESS, 0, 19);
+#endif
+		while (true) {
+			tile_key key;
+			tile_backing* store;
+			{
+				std::unique_lock<std::mutex> lock(guard);
+				wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+				if (stopping)
+					return;
+				key = queue.front();
+				queue.pop_front();
+				store = backing;
+				*abandon[index] = false;
+			}
+			if (cache.contains(key))
+				continue;
+			tile fetched_tile;
+			if (store && store->load(key, fetched_tile)) {
+				cache.insert(key, fetched_tile);
+				continue;
+			}
+			if (!compute_tile(key, fetched_tile, abandon[index].get()))
+				continue;
+			cache.insert(key, fetched_tile);
+			++fetched;
+			if (store)
+				store->save(key, fetched_tile);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,209 @@
+#pragma once
+//Iteration pyramid: finished frames kept at halving resolutions, so zooming out can be previewed at once
+#ifndef __PYRAMID_H__
+#define __PYRAMID_H__
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include "render.h"
+#include "tiles.h"
+
+//Where a frame's pixels sit in the plane: pixel (j, i) covers [left + j * pixel_x, left + (j + 1) * pixel_x)
+//across and the same from top down. The corner is in double-double like the view's.
+struct frame_placement {
+	double_double left;
+	double_double top;
+	long double pixel_x;
+	long double pixel_y;
+	int width;
+	int height;
+};
+
+//Placement of a width x height window onto view, on the tile lattice where it reaches
+frame_placement place_frame(const fractal_view& view, int width, int height) {
+	frame_placement place;
+	lattice_frame frame;
+	if (snap_to_lattice(view, width, height, frame)) {
+		place.pixel_x = frame.pixel_x;
+		place.pixel_y = frame.pixel_y;
+		place.left = frame.x0 * frame.pixel_x;
+		place.top = frame.y0 * frame.pixel_y;
+	}
+	else {
+		place.pixel_x = view_width(view) / width;
+		place.pixel_y = view_height(view) / height;
+		place.left = view.xmin - double_double(place.pixel_x / 2);
+		place.top = view.ymin - double_double(place.pixel_y / 2);
+	}
+	place.width = width;
+	place.height = height;
+	return place;
+}
+
+//Half-resolution copy of an iteration buffer. A coarse pixel is interior if most of the pixels under it are,
+//otherwise it takes the mean of those that escaped.
+void downsample_iterations(const std::vector<int>& fine, int width, int height, std::vector<int>& coarse, int& coarse_width, int& coarse_height) {
+	coarse_width = (width + 1) / 2;
+	coarse_height = (height + 1) / 2;
+	coarse.resize(static_cast<std::size_t>(coarse_width) * coarse_height);
+	for (int b = 0; b < coarse_height; ++b)
+		for (int a = 0; a < coarse_width; ++a) {
+			long long sum = 0;
+			int escaped = 0, under = 0;
+			for (int i = 2 * b; i < std::min(2 * b + 2, height); ++i)
+				for (int j = 2 * a; j < std::min(2 * a + 2, width); ++j) {
+					int value = fine[static_cast<std::size_t>(i) * width + j];
+					++under;
+					if (value != interior) {
+						sum += value;
+						++escaped;
+					}
+				}
+			coarse[static_cast<std::size_t>(b) * coarse_width + a] = (2 * escaped < under) ? interior : static_cast<int>((sum + escaped / 2) / escaped);
+		}
+}
+
+//Compute the pixels of a place.width x place.height frame of view that known leaves unknown. On the lattice they
+//come from render_tiles, which computes only the tiles holding one and keeps them in cache and backing for the
+//exhaustive render to come; off it they are streamed one row per pool task at the points and precision
+//render_block takes.
+void fill_margin(const fractal_view& view, const frame_placement& place, int* out, const std::vector<unsigned char>& known, tile_cache& cache,
+	tile_backing* backing, thread_pool& pool) {
+	std::size_t pixels = static_cast<std::size_t>(place.width) * place.height;
+	lattice_frame frame;
+	if (snap_to_lattice(view, place.width, place.height, frame)) {
+		std::vector<unsigned char> unknown(pixels);
+		for (std::size_t p = 0; p < pixels; ++p)
+			unknown[p] = !known[p];
+		std::vector<int> margin(pixels, interior);
+		render_tiles(view, frame, cache, &margin[0], pool, backing, NULL, NULL, &unknown[0]);
+		for (std::size_t p = 0; p < pixels; ++p)
+			if (unknown[p])
+				out[p] = margin[p];
+		return;
+	}
+	bool deep = deep_view(view, place.width, place.height);
+	pool.parallel_for(0, place.height, [&](int i) {
+		std::vector<int> columns;
+		for (int j = 0; j < place.width; ++j)
+			if (!known[static_cast<std::size_t>(i) * place.width + j])
+				columns.push_back(j);
+		if (columns.empty())
+			return;
+		std::vector<int> values(columns.size());
+		if (deep) {
+			std::vector<cdouble_double> points;
+			for (std::size_t k = 0; k < columns.size(); ++k)
+				points.push_back(deep_pixel_point(view, columns[k], i, place.width, place.height));
+			evaluate_points(view, &points[0], static_cast<int>(points.size()), std::min(place.pixel_x, place.pixel_y), &values[0]);
+		}
+		else {
+			std::vector<clong_double> points;
+			for (std::size_t k = 0; k < columns.size(); ++k)
+				points.push_back(pixel_point(view, columns[k], i, place.width, place.height));
+			evaluate_points(view, &points[0], static_cast<int>(points.size()), std::min(place.pixel_x, place.pixel_y), &values[0]);
+		}
+		for (std::size_t k = 0; k < columns.size(); ++k)
+			out[static_cast<std::size_t>(i) * place.width + columns[k]] = values[k];
+	});
+}
+
+//Recent finished frames, each with its chain of half-resolution copies, up to a byte budget
+class iteration_pyramid {
+public:
+	iteration_pyramid(std::size_t budget_) : budget(budget_) { used = 0; }
+	//Keep a finished frame; the oldest frames go once the budget is spent
+	void add(const fractal_view& view, const frame_placement& place, const int* iterations) {
+		mip_chain chain;
+		chain.view = view;
+		chain.place = place;
+		chain.levels.push_back(std::vector<int>(iterations, iterations + static_cast<std::size_t>(place.width) * place.height));
+		chain.widths.push_back(place.width);
+		chain.heights.push_back(place.height);
+		chain.bytes = chain.levels[0].size() * sizeof(int);
+		while (chain.widths.back() > 1 || chain.heights.back() > 1) {
+			std::vector<int> coarse;
+			int w, h;
+			downsample_iterations(chain.levels.back(), chain.widths.back(), chain.heights.back(), coarse, w, h);
+			chain.bytes += coarse.size() * sizeof(int);
+			chain.levels.push_back(coarse);
+			chain.widths.push_back(w);
+			chain.heights.push_back(h);
+		}
+		//A frame of exactly the same pixels replaces the old one
+		for (std::size_t k = 0; k < frames.size(); ++k)
+			if (same_fractal(frames[k].view, view) && same_placement(frames[k].place, place)) {
+				used -= frames[k].bytes;
+				frames.erase(frames.begin() + k);
+				break;
+			}
+		used += chain.bytes;
+		frames.push_back(chain);
+		while (used > budget && frames.size() > 1) {
+			used -= frames.front().bytes;
+			frames.pop_front();
+		}
+	}
+	//Fill in every pixel of a preview of view that a kept frame of the same fractal, at the same or finer
+	//scale, covers, and mark them in known. Returns how many pixels that was.
+	std::size_t preview(const fractal_view& view, const frame_placement& place, int* out, std::vector<unsigned char>& known) const {
+		known.assign(static_cast<std::size_t>(place.width) * place.height, 0);
+		std::size_t covered = 0;
+		//Coarser frames first, so the finest data ends up on top
+		std::vector<const mip_chain*> order;
+		for (std::size_t k = 0; k < frames.size(); ++k)
+			if (same_fractal(frames[k].view, view) && frames[k].place.pixel_x <= place.pixel_x * 1.0001)
+				order.push_back(&frames[k]);
+		std::stable_sort(order.begin(), order.end(), [](const mip_chain* a, const mip_chain* b) { return a->place.pixel_x > b->place.pixel_x; });
+		for (std::size_t f = 0; f < order.size(); ++f) {
+			const mip_chain& chain = *order[f];
+			//The coarsest level that is still no coarser than the preview
+			int m = 0;
+			while (m + 1 < static_cast<int>(chain.levels.size()) && ldexpl(chain.place.pixel_x, m + 1) <= place.pixel_x * 1.0001)
+				++m;
+			long double size_x = ldexpl(chain.place.pixel_x, m), size_y = ldexpl(chain.place.pixel_y, m);
+			//How far the preview's corner is from the frame's, which long double holds however deep both are
+			long double left = static_cast<long double>(place.left - chain.place.left), top = static_cast<long double>(place.top - chain.place.top);
+			for (int i = 0; i < place.height; ++i) {
+				long double b = floorl((top + (i + 0.5) * place.pixel_y) / size_y);
+				if (b < 0 || b >= chain.heights[m])
+					continue;
+				const int* row = &chain.levels[m][static_cast<std::size_t>(b) * chain.widths[m]];
+				for (int j = 0; j < place.width; ++j) {
+					long double a = floorl((left + (j + 0.5) * place.pixel_x) / size_x);
+					if (a < 0 || a >= chain.widths[m])
+						continue;
+					std::size_t p = static_cast<std::size_t>(i) * place.width + j;
+					covered += !known[p];
+					known[p] = 1;
+					out[p] = row[static_cast<int>(a)];
+				}
+			}
+		}
+		return covered;
+	}
+	void clear() {
+		frames.clear();
+		used = 0;
+	}
+private:
+	struct mip_chain {
+		fractal_view view;
+		frame_placement place;
+		//levels[m] is the frame at 1 / 2^m resolution, widths[m] x heights[m]
+		std::vector<std::vector<int> > levels;
+		std::vector<int> widths;
+		std::vector<int> heights;
+		std::size_t bytes;
+	};
+	// REPRESENTATION
+	std::deque<mip_chain> frames;
+	std::size_t budget;
+	std::size_t used;
+	static bool same_placement(const frame_placement& a, const frame_placement& b) {
+		return a.left == b.left && a.top == b.top && a.pixel_x == b.pixel_x && a.pixel_y == b.pixel_y && a.width == b.width && a.height == b.height;
+	}
+};
+
+#endif
@@ -0,0 +1,224 @@
+#pragma once
+//Region proofs: a whole rectangle of points iterated at once in interval arithmetic, so that a rectangle every
+//point of which escapes at the same step, or never escapes, is settled by one evaluation
+#ifndef __REGIONS_H__
+#define __REGIONS_H__
+#include <algorithm>
+#include <cmath>
+#include "complex.h"
+#include "doubledouble.h"
+
+//A closed range of reals. Every operation rounds its ends outward by a unit in the last place, which is more
+//than the rounding of the same operation on any point inside, so the range holds the floating point orbit
+//escape() computes for each point as well as the exact one.
+struct interval {
+	long double lo;
+	long double hi;
+};
+
+interval make_interval(long double lo, long double hi) {
+	interval range;
+	range.lo = lo;
+	range.hi = hi;
+	return range;
+}
+
+//The long doubles at or outside the double-double range [lo, hi], which holds it however the ends round
+interval make_interval(const double_double& lo, const double_double& hi) {
+	long double below = static_cast<long double>(lo), above = static_cast<long double>(hi);
+	if (double_double(below) > lo)
+		below = nextafterl(below, -HUGE_VALL);
+	if (double_double(above) < hi)
+		above = nextafterl(above, HUGE_VALL);
+	return make_interval(below, above);
+}
+
+interval widened(long double lo, long double hi) {
+	return make_interval(nextafterl(lo, -HUGE_VALL), nextafterl(hi, HUGE_VALL));
+}
+
+interval operator+ (const interval& a, const interval& b) {
+	return widened(a.lo + b.lo, a.hi + b.hi);
+}
+
+interval operator- (const interval& a, const interval& b) {
+	return widened(a.lo - b.hi, a.hi - b.lo);
+}
+
+interval operator* (const interval& a, const interval& b) {
+	long double ends[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+	return widened(*std::min_element(ends, ends + 4), *std::max_element(ends, ends + 4));
+}
+
+//x * x for the same x, which is never negative
+interval square(const interval& a) {
+	long double low = (a.lo > 0) ? a.lo * a.lo : ((a.hi < 0) ? a.hi * a.hi : 0);
+	long double high = std::max(a.lo * a.lo, a.hi * a.hi);
+	return make_interval(std::max(0.0L, nextafterl(low, -HUGE_VALL)), nextafterl(high, HUGE_VALL));
+}
+
+interval absolute(const interval& a) {
+	if (a.lo >= 0)
+		return a;
+	if (a.hi <= 0)
+		return make_interval(-a.hi, -a.lo);
+	return make_interval(0, std::max(-a.lo, a.hi));
+}
+
+//A rectangle of the complex plane
+struct complex_box {
+	interval real;
+	interval imaginary;
+};
+
+//The squares escape() takes, in its order of operations. Doubling is exact, so b * a + a * b is 2 (a * b).
+complex_box square(const complex_box& z) {
+	complex_box out;
+	out.real = square(z.real) - square(z.imaginary);
+	interval product = z.real * z.imaginary;
+	out.imaginary = make_interval(2 * product.lo, 2 * product.hi);
+	return out;
+}
+
+complex_box multiply(const complex_box& a, const complex_box& b) {
+	complex_box out;
+	out.real = a.real * b.real - a.imaginary * b.imaginary;
+	out.imaginary = a.imaginary * b.real + a.real * b.imaginary;
+	return out;
+}
+
+complex_box add(const complex_box& a, const complex_box& b) {
+	complex_box out;
+	out.real = a.real + b.real;
+	out.imaginary = a.imaginary + b.imaginary;
+	return out;
+}
+
+bool inside(const complex_box& a, const complex_box& b) {
+	return a.real.lo >= b.real.lo && a.real.hi <= b.real.hi && a.imaginary.lo >= b.imaginary.lo && a.imaginary.hi <= b.imaginary.hi;
+}
+
+//One step of the map of the given type on a box of orbit points
+complex_box step_region(int type, const complex_box& z, const complex_box& constant) {
+	switch (type) {
+	case 1: {
+		complex_box folded;
+		folded.real = absolute(z.real);
+		folded.imaginary = absolute(z.imaginary);
+		return add(square(folded), constant);
+	}
+	case 3:
+		return add(multiply(square(z), z), constant);
+	}
+	return add(square(z), constant);
+}
+
+//Bounds on the squared distance from 0 of the points of a box, as norm() rounds it
+void region_norm(const complex_box& z, long double& low, long double& high) {
+	interval radius = square(z.real) + square(z.imaginary);
+	low = radius.lo;
+	high = radius.hi;
+}
+
+//An orbit box is tried for trapping itself after 8, 16, 32... steps, for periods up to this
+const int region_trap_periods = 4;
+
+//Whether a box grown a little around z maps into itself within period steps, staying inside the escape
+//radius on the way: then every orbit that reaches z is trapped there for good and never escapes
+bool region_trapped(int type, const complex_box& z, const complex_box& constant, long double threshold, int period) {
+	complex_box grown = z;
+	long double spread_real = (z.real.hi - z.real.lo) / 8 + (fabsl(z.real.lo) + fabsl(z.real.hi)) * 1e-12L;
+	long double spread_imaginary = (z.imaginary.hi - z.imaginary.lo) / 8 + (fabsl(z.imaginary.lo) + fabsl(z.imaginary.hi)) * 1e-12L;
+	grown.real = make_interval(z.real.lo - spread_real, z.real.hi + spread_real);
+	grown.imaginary = make_interval(z.imaginary.lo - spread_imaginary, z.imaginary.hi + spread_imaginary);
+	complex_box image = grown;
+	for (int k = 0; k < period; ++k) {
+		long double low, high;
+		region_norm(image, low, high);
+		if (!(high < threshold * threshold))
+			return false;
+		image = step_region(type, image, constant);
+	}
+	return inside(image, grown);
+}
+
+//Settle a rectangle of points at once, as escape(type, start, point, threshold, depth) would each one: the
+//steps left (depth - i) if every point provably escapes at the same step, -1 (interior) if none ever does, or
+//false if the rectangle is mixed or the ranges grow too loose to tell. Now and then the orbit box is tried for
+//trapping itself, which proves the rectangle interior without following it to depth.
+bool settle_region(int type, const clong_double& start, const complex_box& points, long double threshold, int depth, int& value) {
+	type %= 4;
+	bool julia = type >= 2;
+	complex_box constant;
+	complex_box z;
+	if (julia) {
+		z = points;
+		constant.real = make_interval(start.real, start.real);
+		constant.imaginary = make_interval(start.imaginary, start.imaginary);
+	}
+	else {
+		z.real = make_interval(start.real, start.real);
+		z.imaginary = make_interval(start.imaginary, start.imaginary);
+		constant = points;
+	}
+	long double limit = threshold * threshold;
+	for (int i = 0;; ++i) {
+		long double low, high;
+		region_norm(z, low, high);
+		if (!(high < HUGE_VALL) || low != low)
+			return false;
+		//The Julia types only count a point as escaped once it is past the radius, not on it
+		bool all_out = julia ? low > limit : low >= limit;
+		bool none_out = julia ? high <= limit : high < limit;
+		if (i == depth || !(high < limit)) {
+			if (all_out)
+				value = depth - i;
+			else if (i == depth && none_out)
+				value = -1;
+			else
+				return false;
+			return true;
+		}
+		if (i >= 8 && (i & (i - 1)) == 0)
+			for (int period = 1; period <= region_trap_periods; ++period)
+				if (region_trapped(type, z, constant, threshold, period)) {
+					value = -1;
+					return true;
+				}
+		z = step_region(type, z, constant);
+	}
+}
+
+//Settle what it can of a columns x rows block of pixels, point(j, i) being where pixel (j, i) is, which must
+//rise with j and with i. Points are long double or, where pixels are evaluated in double-double, double-double,
+//whose corners are rounded outward so the box holds every pixel evaluated inside it. Rectangles the interval iteration cannot settle are split in four down to
+//min_side; with escapes false only interior (-1) rectangles are taken, and a rectangle that provably escapes
+//is left to be evaluated pixel by pixel. Settled pixels get their value in out and are marked in settled.
+template <class Point>
+void settle_block(int type, const clong_double& start, long double threshold, int depth, bool escapes, int j0, int i0, int columns, int rows,
+	int stride, const Point& point, int* out, unsigned char* settled, int min_side = 8) {
+	if (columns <= 0 || rows <= 0 || columns * rows < min_side * min_side)
+		return;
+	auto first = point(j0, i0), last = point(j0 + columns - 1, i0 + rows - 1);
+	complex_box box;
+	box.real = make_interval(first.real, last.real);
+	box.imaginary = make_interval(first.imaginary, last.imaginary);
+	int value;
+	if (settle_region(type, start, box, threshold, depth, value)) {
+		if (!escapes && value != -1)
+			return;
+		for (int i = i0; i < i0 + rows; ++i)
+			for (int j = j0; j < j0 + columns; ++j) {
+				out[i * stride + j] = value;
+				settled[i * stride + j] = 1;
+			}
+		return;
+	}
+	int left = columns / 2, top = rows / 2;
+	settle_block(type, start, threshold, depth, escapes, j0, i0, left, top, stride, point, out, settled, min_side);
+	settle_block(type, start, threshold, depth, escapes, j0 + left, i0, columns - left, top, stride, point, out, settled, min_side);
+	settle_block(type, start, threshold, depth, escapes, j0, i0 + top, left, rows - top, stride, point, out, settled, min_side);
+	settle_block(type, start, threshold, depth, escapes, j0 + left, i0 + top, columns - left, rows - top, stride, point, out, settled, min_side);
+}
+
+#endif
@@ -0,0 +1,386 @@
+#pragma once
+//Window-free rendering: which part of the plane is drawn, iteration buffers, and their coloring
+#ifndef __RENDER_H__
+#define __RENDER_H__
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "batch.h"
+#include "complex.h"
+#include "doubledouble.h"
+#include "gradients.h"
+#include "regions.h"
+#include "threadpool.h"
+
+//Escape radius used by every renderer
+const long double escape_threshold = 2.0;
+
+//Iteration value stored for points that never escaped
+const int interior = -1;
+
+//Everything needed to say which picture of the plane is being drawn
+struct fractal_view {
+	//Bounds in double-double, so a view can sit deeper than long double resolves its corners, which under MSVC is
+	//only double
+	double_double xmin;
+	double_double xmax;
+	double_double ymin;
+	double_double ymax;
+	int fractal_type;
+	clong_double starting_point;
+	int maxiterations;
+};
+
+//Two views are the same picture only if every field matches exactly
+bool same_view(const fractal_view& a, const fractal_view& b) {
+	return a.xmin == b.xmin && a.xmax == b.xmax && a.ymin == b.ymin && a.ymax == b.ymax
+		&& a.fractal_type == b.fractal_type && a.maxiterations == b.maxiterations
+		&& a.starting_point.real == b.starting_point.real && a.starting_point.imaginary == b.starting_point.imaginary;
+}
+
+//Whether two views show the same fractal, whatever part of the plane they look at
+bool same_fractal(const fractal_view& a, const fractal_view& b) {
+	return a.fractal_type % 4 == b.fractal_type % 4 && a.starting_point.real == b.starting_point.real
+		&& a.starting_point.imaginary == b.starting_point.imaginary && a.maxiterations == b.maxiterations;
+}
+
+//Sizes of the view, which long double holds however deep the view is
+long double view_width(const fractal_view& view) {
+	return static_cast<long double>(view.xmax - view.xmin);
+}
+
+long double view_height(const fractal_view& view) {
+	return static_cast<long double>(view.ymax - view.ymin);
+}
+
+//The largest coordinate of the view's corners and starting point
+long double view_reach(const fractal_view& view) {
+	long double reach = std::max(std::max(fabsl(static_cast<long double>(view.xmin)), fabsl(static_cast<long double>(view.xmax))),
+		std::max(fabsl(static_cast<long double>(view.ymin)), fabsl(static_cast<long double>(view.ymax))));
+	return std::max(reach, std::max(fabsl(view.starting_point.real), fabsl(view.starting_point.imaginary)));
+}
+
+//The point sampled by pixel (column, row) of a width x height image; row 0 is ymin, like the window
+clong_double pixel_point(const fractal_view& view, long long column, long long row, long long width, long long height) {
+	return clong_double(
+		(static_cast<long double>(column) / static_cast<long double>(width)) * view_width(view) + static_cast<long double>(view.xmin),
+		(static_cast<long double>(row) / static_cast<long double>(height)) * view_height(view) + static_cast<long double>(view.ymin));
+}
+
+//Iteration value of a single point, or interior if it never escaped. Given pixel, how far apart the points being
+//drawn are, orbits caught by an attracting cycle stop early.
+int evaluate(const fractal_view& view, const clong_double& dot, long double pixel = 0.0) {
+	int period;
+	std::pair<bool, int> eval = escape(view.fractal_type, view.starting_point, dot, escape_threshold, view.maxiterations, NULL, &period, NULL,
+		(pixel > 0) ? cycle_tolerance(pixel) : 0.0);
+	return eval.first ? eval.second : interior;
+}
+
+//Pixel spacing, in units in the last place of long double at the largest coordinate an orbit reaches, below
+//which evaluation switches to double-double: rounding in the orbit would otherwise blur neighboring pixels
+const long double double_double_ulps = 1024.0;
+
+//Whether pixels this far apart, around coordinates no larger than reach, need double-double
+bool deep_pixels(long double reach, long double pixel) {
+	return pixel < std::max(reach, escape_threshold) * LDBL_EPSILON * double_double_ulps;
+}
+
+bool deep_view(const fractal_view& view, long long width, long long height) {
+	long double reach = std::max(std::max(fabsl(static_cast<long double>(view.xmin)), fabsl(static_cast<long double>(view.xmax))),
+		std::max(fabsl(static_cast<long double>(view.ymin)), fabsl(static_cast<long double>(view.ymax))));
+	return deep_pixels(reach, std::min(view_width(view) / width, view_height(view) / height));
+}
+
+//pixel_point in double-double from the view's double-double corners, which keeps pixels apart past where long
+//double can
+cdouble_double deep_pixel_point(const fractal_view& view, long long column, long long row, long long width, long long height) {
+	return cdouble_double(
+		(view.xmax - view.xmin) * double_double(static_cast<double>(column)) / static_cast<double>(width) + view.xmin,
+		(view.ymax - view.ymin) * double_double(static_cast<double>(row)) / static_cast<double>(height) + view.ymin);
+}
+
+//Iteration values of count points, pixel apart, into out, in the precision of the points, streamed through
+//batch_lanes lanes
+template <class T>
+void evaluate_points(const fractal_view& view, const basic_complex<T>* points, int count, long double pixel, int* out) {
+	std::vector<std::pair<bool, int> > results(count);
+	std::vector<int> period(count);
+	escape_stream<T, batch_lanes>(view.fractal_type, basic_complex<T>(view.starting_point), points, count, static_cast<T>(escape_threshold),
+		view.maxiterations, &results[0], static_cast<basic_complex<T>*>(NULL), &period[0], NULL, cycle_tolerance(pixel));
+	for (int k = 0; k < count; ++k)
+		out[k] = results[k].first ? results[k].second : interior;
+}
+
+//Continuous escape count: the steps taken plus how far the last one overshot the escape radius
+float smooth_count(int type, int steps, const clong_double& last) {
+	long double power = (type % 4 == 3) ? 3.0 : 2.0;
+	long double radius = last.magnitude();
+	if (!(radius > escape_threshold))
+		return static_cast<float>(steps);
+	return static_cast<float>(steps + 1 - logl(logl(radius) / logl(escape_threshold)) / logl(power));
+}
+
+//Side of the squares render_block hands out to the pool
+const int render_cell = 32;
+
+//Fill the columns x rows block at (column0, row0) of a width x height image into out, one square per pool
+//task. Rectangles of a square that interval iteration settles are filled whole; the rest go on one worklist
+//per square, streamed through the lanes, in double-double if the view is too deep for long double.
+void render_block(const fractal_view& view, long long width, long long height, long long column0, long long row0, int columns, int rows, int* out, thread_pool& pool) {
+	int across = (columns + render_cell - 1) / render_cell, down = (rows + render_cell - 1) / render_cell;
+	std::vector<unsigned char> settled(static_cast<std::size_t>(columns) * rows, 0);
+	bool deep = deep_view(view, width, height);
+	long double pixel = std::min(view_width(view) / width, view_height(view) / height);
+	pool.parallel_for(0, across * down, [&](int cell) {
+		int j0 = (cell % across) * render_cell, i0 = (cell / across) * render_cell;
+		int cell_columns = std::min(render_cell, columns - j0), cell_rows = std::min(render_cell, rows - i0);
+		if (deep)
+			settle_block(view.fractal_type, view.starting_point, escape_threshold, view.maxiterations, true, j0, i0, cell_columns, cell_rows, columns,
+				[&](int j, int i) { return deep_pixel_point(view, column0 + j, row0 + i, width, height); }, out, &settled[0]);
+		else
+			settle_block(view.fractal_type, view.starting_point, escape_threshold, view.maxiterations, true, j0, i0, cell_columns, cell_rows, columns,
+				[&](int j, int i) { return pixel_point(view, column0 + j, row0 + i, width, height); }, out, &settled[0]);
+		std::vector<std::size_t> places;
+		for (int i = i0; i < i0 + cell_rows; ++i)
+			for (int j = j0; j < j0 + cell_columns; ++j)
+				if (!settled[static_cast<std::size_t>(i) * columns + j])
+					places.push_back(static_cast<std::size_t>(i) * columns + j);
+		std::vector<int> values(places.size());
+		if (places.empty())
+			return;
+		if (deep) {
+			std::vector<cdouble_double> points;
+			for (std::size_t k = 0; k < places.size(); ++k)
+				points.push_back(deep_pixel_point(view, column0 + places[k] % columns, row0 + places[k] / columns, width, height));
+			evaluate_points(view, &points[0], static_cast<int>(points.size()), pixel, &values[0]);
+		}
+		else {
+			std::vector<clong_double> points;
+			for (std::size_t k = 0; k < places.size(); ++k)
+				points.push_back(pixel_point(view, column0 + places[k] % columns, row0 + places[k] / columns, width, height));
+			evaluate_points(view, &points[0], static_cast<int>(points.size()), pixel, &values[0]);
+		}
+		for (std::size_t k = 0; k < places.size(); ++k)
+			out[places[k]] = values[k];
+	});
+}
+
+//Fill rows [row0, row0 + rows) of a width x height image into out, as render_block fills a block the image's
+//width across
+void render_rows(const fractal_view& view, long long width, long long height, long long row0, int rows, int* out, thread_pool& pool) {
+	render_block(view, width, height, 0, row0, static_cast<int>(width), rows, out, pool);
+}
+
+//RGB bytes for every iteration value 0..maxiterations, matching what recompile_gradients() compiles
+std::vector<unsigned char> build_palette(const gradient& scheme, int maxiterations, long double moddenom, long double offset = 0.0) {
+	std::vector<unsigned char> palette(3 * (maxiterations + 1));
+	for (int j = 0; j <= maxiterations; ++j) {
+		long double t = fmodl(static_cast<long double>(j) + offset, moddenom);
+		if (t < 0.0)
+			t += moddenom;
+		fgr::fcolor col = mapgradient(t / moddenom, scheme);
+		float levels[3] = { col.R, col.G, col.B };
+		for (int k = 0; k < 3; ++k)
+			palette[3 * j + k] = static_cast<unsigned char>(fminf(fmaxf(levels[k], 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+	return palette;
+}
+
+//Turn iteration values into RGB bytes; interior points stay black like the GL background
+void colorize(const int* iterations, std::size_t count, const std::vector<unsigned char>& palette, unsigned char* rgb) {
+	int top = static_cast<int>(palette.size() / 3) - 1;
+	for (std::size_t p = 0; p < count; ++p) {
+		if (iterations[p] == interior) {
+			rgb[3 * p] = rgb[3 * p + 1] = rgb[3 * p + 2] = 0;
+			continue;
+		}
+		const unsigned char* col = &palette[3 * std::min(iterations[p], top)];
+		rgb[3 * p] = col[0];
+		rgb[3 * p + 1] = col[1];
+		rgb[3 * p + 2] = col[2];
+	}
+}
+
+//Open a file through MSVC's secure CRT where it insists on it, plain fopen elsewhere
+FILE* open_file(const std::string& path, const char* mode) {
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, path.c_str(), mode);
+#else
+	file = fopen(path.c_str(), mode);
+#endif
+	return file;
+}
+
+//Move to a byte offset that may be past 2GB
+bool seek_file(FILE* file, long long offset) {
+#ifdef _MSC_VER
+	return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+
+//Length in bytes of an open file, which may be past 2GB; leaves the position at the end
+long long file_length(FILE* file) {
+#ifdef _MSC_VER
+	if (_fseeki64(file, 0, SEEK_END) != 0)
+		return -1;
+	return _ftelli64(file);
+#else
+	if (fseeko(file, 0, SEEK_END) != 0)
+		return -1;
+	return ftello(file);
+#endif
+}
+
+//Put from in place of to in one step, so to is always either the old file or the new one
+bool replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+//A view bound as a hex float, followed by its low word with its sign where it has one: "0x1.8p-1-0x1p-60"
+std::string bound_to_string(const double_double& value) {
+	char buffer[64];
+	if (value.lo != 0)
+		snprintf(buffer, sizeof(buffer), "%a%+a", value.hi, value.lo);
+	else
+		snprintf(buffer, sizeof(buffer), "%a", value.hi);
+	return buffer;
+}
+
+//Read a bound as bound_to_string writes it, or as a single long double; end is left past it
+double_double bound_from_string(const char* pos, char** end) {
+	double_double value(strtold(pos, end));
+	if (*end != pos && (**end == '+' || **end == '-')) {
+		char* after;
+		double lo = strtod(*end, &after);
+		if (after != *end) {
+			value = value + double_double(lo);
+			*end = after;
+		}
+	}
+	return value;
+}
+
+//Views are written as hex floats so they survive a round trip through text bit-for-bit
+std::string view_to_string(const fractal_view& view) {
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer), "%s %s %s %s %d %La %La %d",
+		bound_to_string(view.xmin).c_str(), bound_to_string(view.xmax).c_str(), bound_to_string(view.ymin).c_str(),
+		bound_to_string(view.ymax).c_str(), view.fractal_type, view.starting_point.real, view.starting_point.imaginary, view.maxiterations);
+	return buffer;
+}
+
+//Inverse of view_to_string; returns false if the text is not a whole view
+bool view_from_string(const std::string& text, fractal_view& view) {
+	const char* pos = text.c_str();
+	char* end;
+	double_double bounds[4];
+	for (int k = 0; k < 4; ++k) {
+		bounds[k] = bound_from_string(pos, &end);
+		if (end == pos)
+			return false;
+		pos = end;
+	}
+	int type = strtol(pos, &end, 10);
+	if (end == pos)
+		return false;
+	pos = end;
+	long double real = strtold(pos, &end);
+	if (end == pos)
+		return false;
+	pos = end;
+	long double imaginary = strtold(pos, &end);
+	if (end == pos)
+		return false;
+	pos = end;
+	int depth = strtol(pos, &end, 10);
+	if (end == pos)
+		return false;
+	view.xmin = bounds[0];
+	view.xmax = bounds[1];
+	view.ymin = bounds[2];
+	view.ymax = bounds[3];
+	view.fractal_type = type;
+	view.starting_point = clong_double(real, imaginary);
+	view.maxiterations = depth;
+	return true;
+}
+
+//Read up to count comma-separated numbers out of text
+int parse_reals(const std::string& text, long double* values, int count) {
+	const char* pos = text.c_str();
+	char* end;
+	int k = 0;
+	for (; k < count; ++k) {
+		values[k] = strtold(pos, &end);
+		if (end == pos)
+			break;
+		pos = (*end == ',') ? end + 1 : end;
+	}
+	return k;
+}
+
+//Read count whitespace-separated integers; returns where parsing stopped, or NULL if there were too few
+const char* parse_integers(const char* pos, long long* values, int count) {
+	char* end;
+	for (int k = 0; k < count; ++k) {
+		values[k] = strtoll(pos, &end, 10);
+		if (end == pos)
+			return NULL;
+		pos = end;
+	}
+	return pos;
+}
+
+//Command-line options shared by the headless modes: --view=xmin,xmax,ymin,ymax --type=n --iter=n --start=re,im
+bool parse_view_option(const std::string& arg, fractal_view& view) {
+	long double values[2];
+	if (arg.compare(0, 7, "--view=") == 0) {
+		//Bounds are read as bound_from_string reads them, so a view's low words can be given too
+		double_double bounds[4];
+		const char* pos = arg.c_str() + 7;
+		char* end;
+		int k = 0;
+		for (; k < 4; ++k) {
+			bounds[k] = bound_from_string(pos, &end);
+			if (end == pos)
+				break;
+			pos = (*end == ',') ? end + 1 : end;
+		}
+		if (k < 4)
+			return false;
+		view.xmin = bounds[0];
+		view.xmax = bounds[1];
+		view.ymin = bounds[2];
+		view.ymax = bounds[3];
+		return true;
+	}
+	if (arg.compare(0, 7, "--type=") == 0) {
+		view.fractal_type = atoi(arg.c_str() + 7);
+		return true;
+	}
+	if (arg.compare(0, 7, "--iter=") == 0) {
+		view.maxiterations = atoi(arg.c_str() + 7);
+		return true;
+	}
+	if (arg.compare(0, 8, "--start=") == 0 && parse_reals(arg.substr(8), values, 2) == 2) {
+		view.starting_point = clong_double(values[0], values[1]);
+		return true;
+	}
+	return false;
+}
+
+#endif
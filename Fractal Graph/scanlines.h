@@ -0,0 +1,192 @@
+#pragma once
+//Scanline interval cache: what is already known along horizontal lines of the plane, as sorted spans
+#ifndef __SCANLINES_H__
+#define __SCANLINES_H__
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "render.h"
+
+//A stretch of one scanline whose samples, pixel apart from lo to hi, all escaped (least to most iterations
+//left) or were all interior (least and most both interior)
+struct scanline_span {
+	long double lo;
+	long double hi;
+	long double pixel;
+	int least;
+	int most;
+};
+
+//Spans recorded along scanlines of one fractal, keyed by imaginary coordinate. Scanlines come from rendered rows,
+//so they sit on lattice pixel centers and the same rows are found again by every later view at that scale. A point
+//is taken to be interior if the recorded scanlines on either side of it, no further apart than their own pixels,
+//are both interior a pixel either side of it: for the Mandelbrot set and the filled Julia sets, which have no
+//holes, a box with an interior rim is interior. The burning ship has holes and is never answered for.
+class scanline_cache {
+public:
+	scanline_cache(std::size_t budget_) : budget(budget_) { used = 0; valid = false; }
+	//Record count pixels of a row at imaginary, centered at left + k * pixel, replacing what was known there
+	void record(const fractal_view& view, long double imaginary, long double left, long double pixel, const int* iterations, int count) {
+		std::lock_guard<std::mutex> lock(guard);
+		if (!valid || !same_fractal(fractal, view)) {
+			drop_all();
+			fractal = view;
+			valid = true;
+		}
+		std::map<long double, scanline>::iterator found = lines.find(imaginary);
+		if (found == lines.end()) {
+			found = lines.insert(std::make_pair(imaginary, scanline())).first;
+			found->second.place = order.insert(order.end(), imaginary);
+		}
+		else
+			order.splice(order.end(), order, found->second.place);
+		std::vector<scanline_span>& spans = found->second.spans;
+		used -= spans.size() * sizeof(scanline_span);
+		//Cut out whatever the new pixels cover
+		long double from = left - pixel / 2, to = left + (count - 0.5) * pixel;
+		std::vector<scanline_span> kept;
+		for (std::size_t k = 0; k < spans.size(); ++k) {
+			const scanline_span& span = spans[k];
+			if (span.hi < from || span.lo > to) {
+				kept.push_back(span);
+				continue;
+			}
+			if (span.lo < from) {
+				kept.push_back(span);
+				kept.back().hi = from;
+			}
+			if (span.hi > to) {
+				kept.push_back(span);
+				kept.back().lo = to;
+			}
+		}
+		for (int k = 0; k < count;) {
+			int end = k + 1;
+			bool inside = iterations[k] == interior;
+			scanline_span span;
+			span.least = span.most = iterations[k];
+			while (end < count && (iterations[end] == interior) == inside) {
+				span.least = std::min(span.least, iterations[end]);
+				span.most = std::max(span.most, iterations[end]);
+				++end;
+			}
+			span.lo = left + k * pixel;
+			span.hi = left + (end - 1) * pixel;
+			span.pixel = pixel;
+			kept.push_back(span);
+			k = end;
+		}
+		std::sort(kept.begin(), kept.end(), [](const scanline_span& a, const scanline_span& b) { return a.lo < b.lo; });
+		//Join touching spans of the same kind, so rows recorded a tile at a time become whole
+		spans.clear();
+		for (std::size_t k = 0; k < kept.size(); ++k) {
+			if (!spans.empty()) {
+				scanline_span& last = spans.back();
+				bool inside = last.least == interior;
+				if (inside == (kept[k].least == interior) && kept[k].lo - last.hi <= std::max(last.pixel, kept[k].pixel) * 1.0001) {
+					last.hi = std::max(last.hi, kept[k].hi);
+					last.pixel = std::max(last.pixel, kept[k].pixel);
+					last.least = std::min(last.least, kept[k].least);
+					last.most = std::max(last.most, kept[k].most);
+					continue;
+				}
+			}
+			spans.push_back(kept[k]);
+		}
+		used += spans.size() * sizeof(scanline_span);
+		//The scanlines least recently recorded go first; the one just recorded is at the back of the line and is kept
+		while (used > budget && order.size() > 1) {
+			std::map<long double, scanline>::iterator oldest = lines.find(order.front());
+			order.pop_front();
+			used -= oldest->second.spans.size() * sizeof(scanline_span);
+			lines.erase(oldest);
+		}
+	}
+	//Mark in known the pixels of a row of view, placed like those record takes, that are known to be interior.
+	//Returns how many were marked.
+	int interior_row(const fractal_view& view, long double imaginary, long double left, long double pixel, int count, unsigned char* known) {
+		std::lock_guard<std::mutex> lock(guard);
+		if (!valid || !same_fractal(fractal, view) || view.fractal_type % 4 == 1 || lines.empty())
+			return 0;
+		std::map<long double, scanline>::const_iterator start = lines.lower_bound(imaginary);
+		int marked = 0;
+		for (int k = 0; k < count; ++k) {
+			if (known[k])
+				continue;
+			long double real = left + k * pixel;
+			//The nearest scanlines either side that have anything recorded here; exactly on one, it is enough
+			const scanline_span* top = NULL;
+			const scanline_span* bottom = NULL;
+			long double top_at = 0, bottom_at = 0;
+			std::map<long double, scanline>::const_iterator line = start;
+			for (int steps = 0; line != lines.end() && steps < search_lines && !top; ++line, ++steps)
+				if ((top = recorded(line->second.spans, real)) != NULL)
+					top_at = line->first;
+			if (!top)
+				continue;
+			if (top_at == imaginary)
+				bottom = top, bottom_at = top_at;
+			line = start;
+			for (int steps = 0; line != lines.begin() && steps < search_lines && !bottom; ++steps)
+				if ((bottom = recorded((--line)->second.spans, real)) != NULL)
+					bottom_at = line->first;
+			if (!bottom || top->least != interior || bottom->least != interior || top_at - bottom_at > std::min(top->pixel, bottom->pixel) * 1.0001)
+				continue;
+			//Two pixels of margin either way along both
+			if (top->lo > real - 2 * top->pixel || top->hi < real + 2 * top->pixel || bottom->lo > real - 2 * bottom->pixel || bottom->hi < real + 2 * bottom->pixel)
+				continue;
+			known[k] = 1;
+			++marked;
+		}
+		return marked;
+	}
+	//Whether a single point of view is known to be interior
+	bool interior_at(const fractal_view& view, const clong_double& point) {
+		unsigned char known = 0;
+		return interior_row(view, point.imaginary, point.real, 0, 1, &known) > 0;
+	}
+	void clear() {
+		std::lock_guard<std::mutex> lock(guard);
+		drop_all();
+		valid = false;
+	}
+	//Spans held
+	std::size_t size() {
+		std::lock_guard<std::mutex> lock(guard);
+		return used / sizeof(scanline_span);
+	}
+private:
+	//The spans of one scanline and its place in order
+	struct scanline {
+		std::vector<scanline_span> spans;
+		std::list<long double>::iterator place;
+	};
+	// REPRESENTATION
+	std::map<long double, scanline> lines;
+	//Scanlines from least to most recently recorded
+	std::list<long double> order;
+	fractal_view fractal;
+	bool valid;
+	std::size_t budget;
+	std::size_t used;
+	std::mutex guard;
+	//How many scanlines a query looks past for one with something recorded where it asks
+	static const int search_lines = 64;
+	void drop_all() {
+		lines.clear();
+		order.clear();
+		used = 0;
+	}
+	//The span of spans whose pixels take in real, if there is one
+	static const scanline_span* recorded(const std::vector<scanline_span>& spans, long double real) {
+		std::vector<scanline_span>::const_iterator next = std::upper_bound(spans.begin(), spans.end(), real,
+			[](long double x, const scanline_span& span) { return x < span.lo - span.pixel / 2; });
+		if (next == spans.begin() || (next - 1)->hi + (next - 1)->pixel / 2 < real)
+			return NULL;
+		return &*(next - 1);
+	}
+};
+
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+//Session snapshots: the view, settings and last frame saved on exit so the next launch can show them at once
+#ifndef __SESSION_H__
+#define __SESSION_H__
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+#include "render.h"
+#include "varint.h"
+
+//Everything a session is restored from
+struct session_state {
+	fractal_view view;
+	int scheme;
+	long double moddenom;
+	long double speed;
+	long long sampling;
+	long double point_size;
+	//The frame on screen when the session ended, width x height, or empty if it was not of this view
+	int width;
+	int height;
+	std::vector<int> iterations;
+};
+
+const char session_magic[] = "fractal-session 1";
+
+//Three text lines (magic, view, settings and frame size) and then the frame, compressed like tile store tiles.
+//Written to a temporary file and moved over the old one, so a crash while saving keeps the previous snapshot.
+bool save_session(const std::string& path, const session_state& state) {
+	std::string packed;
+	if (!state.iterations.empty())
+		compress_iterations(state.iterations.data(), state.iterations.size(), packed);
+	char settings[256];
+	snprintf(settings, sizeof(settings), "%d %La %La %lld %La %d %d %lld", state.scheme, state.moddenom, state.speed, state.sampling,
+		state.point_size, state.iterations.empty() ? 0 : state.width, state.iterations.empty() ? 0 : state.height, static_cast<long long>(packed.size()));
+	std::string text = std::string(session_magic) + "\n" + view_to_string(state.view) + "\n" + settings + "\n";
+	FILE* file = open_file(path + ".tmp", "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(text.data(), 1, text.size(), file) == text.size() && fwrite(packed.data(), 1, packed.size(), file) == packed.size();
+	ok = (fclose(file) == 0) && ok;
+	return ok && replace_file(path + ".tmp", path);
+}
+
+//Read a snapshot through a read-only memory map; returns false, leaving state alone, if it is missing or damaged
+bool load_session(const std::string& path, session_state& state) {
+	mapped_file map;
+	if (!map.open_read(path))
+		return false;
+	const char* begin = reinterpret_cast<const char*>(map.data());
+	const char* end = begin + map.size();
+	std::string lines[3];
+	const char* pos = begin;
+	for (int k = 0; k < 3; ++k) {
+		const char* stop = pos;
+		while (stop < end && *stop != '\n')
+			++stop;
+		if (stop == end)
+			return false;
+		lines[k].assign(pos, stop);
+		pos = stop + 1;
+	}
+	session_state loaded;
+	if (lines[0] != session_magic || !view_from_string(lines[1], loaded.view))
+		return false;
+	const char* field = lines[2].c_str();
+	char* after;
+	long long integers[4];
+	long double reals[3];
+	loaded.scheme = static_cast<int>(strtol(field, &after, 10));
+	if (after == field)
+		return false;
+	field = after;
+	for (int k = 0; k < 2; ++k) {
+		reals[k] = strtold(field, &after);
+		if (after == field)
+			return false;
+		field = after;
+	}
+	if (!(field = parse_integers(field, integers, 1)))
+		return false;
+	reals[2] = strtold(field, &after);
+	if (after == field || !parse_integers(after, integers + 1, 3))
+		return false;
+	loaded.moddenom = reals[0];
+	loaded.speed = reals[1];
+	loaded.sampling = integers[0];
+	loaded.point_size = reals[2];
+	loaded.width = static_cast<int>(integers[1]);
+	loaded.height = static_cast<int>(integers[2]);
+	if (loaded.width < 0 || loaded.height < 0 || integers[3] < 0 || integers[3] > end - pos)
+		return false;
+	loaded.iterations.resize(static_cast<std::size_t>(loaded.width) * loaded.height);
+	const unsigned char* packed = reinterpret_cast<const unsigned char*>(pos);
+	if (!loaded.iterations.empty() && !expand_iterations(packed, packed + integers[3], loaded.iterations.data(), loaded.iterations.size()))
+		return false;
+	//A damaged frame could still expand; anything colorize has no colour for is refused
+	for (std::size_t p = 0; p < loaded.iterations.size(); ++p)
+		if (loaded.iterations[p] < interior || loaded.iterations[p] > loaded.view.maxiterations)
+			return false;
+	state = loaded;
+	return true;
+}
+
+#endif
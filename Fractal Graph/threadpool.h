@@ -0,0 +1,93 @@
+#pragma once
+//A small fixed-size pool of worker threads shared by every renderer in the program
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool {
+public:
+	//Start a pool with one worker per hardware thread unless told otherwise
+	thread_pool(unsigned int threads = std::thread::hardware_concurrency()) {
+		if (threads == 0)
+			threads = 1;
+		stopping = false;
+		for (unsigned int i = 0; i < threads; ++i)
+			workers.push_back(std::thread(&thread_pool::work, this));
+	}
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(guard);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+	unsigned int size() const { return workers.size(); }
+	//Queue a task for whichever worker frees up first
+	void submit(std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> lock(guard);
+			tasks.push_back(task);
+		}
+		wake.notify_one();
+	}
+	//Run body(i) for every i in [begin, end) across the pool, returning once all of them are done
+	void parallel_for(int begin, int end, const std::function<void(int)>& body) {
+		if (end <= begin)
+			return;
+		std::atomic<int> next(begin);
+		std::mutex done_guard;
+		std::condition_variable done;
+		unsigned int running = std::min<unsigned int>(size(), end - begin);
+		unsigned int finished = 0;
+		for (unsigned int t = 0; t < running; ++t) {
+			submit([&]() {
+				for (int i = next++; i < end; i = next++)
+					body(i);
+				std::lock_guard<std::mutex> lock(done_guard);
+				if (++finished == running)
+					done.notify_one();
+			});
+		}
+		std::unique_lock<std::mutex> lock(done_guard);
+		done.wait(lock, [&]() { return finished == running; });
+	}
+private:
+	// REPRESENTATION
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex guard;
+	std::condition_variable wake;
+	bool stopping;
+	//The loop each worker runs until the pool is destroyed
+	void work() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(guard);
+				wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty())
+					return;
+				task = tasks.front();
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+};
+
+//The pool every renderer shares, started on first use
+thread_pool& render_pool() {
+	static thread_pool pool;
+	return pool;
+}
+
+#endif
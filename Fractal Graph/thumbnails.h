@@ -0,0 +1,205 @@
+#pragma once
+//Thumbnails: small shallow renders in 32-bit fixed point, sixteen pixels to a batch, and a batch mode that
+//writes a PNG thumbnail for every view in a list
+#ifndef __THUMBNAILS_H__
+#define __THUMBNAILS_H__
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "pngwrite.h"
+#include "render.h"
+
+//Pixels in a batch of the thumbnail kernel: sixteen 32-bit lanes fill one AVX-512 register or two AVX ones
+const int thumbnail_lanes = 16;
+
+//Fraction bits of the kernel's fixed point: 28 for the quadratic maps, whose steps stay under 8 in size from
+//inside the escape radius, and 26 for the cubic one, whose steps reach 8 before the constant is added
+int thumbnail_fraction(int type) {
+	return (type % 4 == 3) ? 26 : 28;
+}
+
+//Thumbnails are only taken in fixed point where a pixel spans at least this many of its units
+const long double thumbnail_pixel_units = 256.0;
+
+//Whether the thumbnail kernel can render view at width x height: every step from inside the escape radius,
+//constant included, must fit in 32 bits, and the pixels must be coarse enough for the fraction bits
+bool thumbnail_fits(const fractal_view& view, long long width, long long height) {
+	int fraction = thumbnail_fraction(view.fractal_type);
+	long double reach = view_reach(view);
+	long double step = powl(escape_threshold, (view.fractal_type % 4 == 3) ? 3.0 : 2.0);
+	long double pixel = std::min(view_width(view) / width, view_height(view) / height);
+	return escape_threshold <= 2.0 && step + reach < ldexpl(1.0, 31 - fraction) && pixel >= ldexpl(thumbnail_pixel_units, -fraction);
+}
+
+//The fixed point number at or below value
+std::int32_t to_thumbnail(long double value, int fraction) {
+	return static_cast<std::int32_t>(floorl(ldexpl(value, fraction)));
+}
+
+//escape(type, start, point, escape_threshold, depth) for thumbnail_lanes points (x[k], y[k]) and the constant or
+//starting point (kx, ky), all in fixed point with fraction bits, each lane's result in results[k]. Squares are
+//taken in 64 bits and shifted back down; an orbit that returns exactly to where it was at the last power of two
+//steps repeats forever and is stopped as interior.
+void escape_thumbnail_batch(int type, std::int32_t kx, std::int32_t ky, const std::int32_t* x, const std::int32_t* y, int depth, int fraction,
+	std::pair<bool, int>* results) {
+	type %= 4;
+	bool julia = type >= 2;
+	std::int32_t zx[thumbnail_lanes], zy[thumbnail_lanes], cx[thumbnail_lanes], cy[thumbnail_lanes], sx[thumbnail_lanes], sy[thumbnail_lanes];
+	std::int32_t active[thumbnail_lanes], caught[thumbnail_lanes], steps[thumbnail_lanes];
+	std::int64_t xx[thumbnail_lanes], yy[thumbnail_lanes];
+	std::int64_t limit = static_cast<std::int64_t>(ldexpl(escape_threshold * escape_threshold, 2 * fraction));
+	for (int lane = 0; lane < thumbnail_lanes; ++lane) {
+		zx[lane] = sx[lane] = julia ? x[lane] : kx;
+		zy[lane] = sy[lane] = julia ? y[lane] : ky;
+		cx[lane] = julia ? kx : x[lane];
+		cy[lane] = julia ? ky : y[lane];
+		active[lane] = 1;
+		caught[lane] = 0;
+		steps[lane] = 0;
+	}
+	int next_save = 8;
+	for (int i = 0;; ++i) {
+		std::int32_t live = 0;
+		for (int lane = 0; lane < thumbnail_lanes; ++lane) {
+			xx[lane] = static_cast<std::int64_t>(zx[lane]) * zx[lane];
+			yy[lane] = static_cast<std::int64_t>(zy[lane]) * zy[lane];
+			active[lane] &= (xx[lane] + yy[lane] < limit);
+			live |= active[lane];
+		}
+		if (i == depth || !live)
+			break;
+		for (int lane = 0; lane < thumbnail_lanes; ++lane) {
+			std::int32_t a = zx[lane], b = zy[lane];
+			if (type == 1) {
+				a = (a < 0) ? -a : a;
+				b = (b < 0) ? -b : b;
+			}
+			std::int32_t real = static_cast<std::int32_t>((xx[lane] - yy[lane]) >> fraction);
+			std::int32_t imaginary = static_cast<std::int32_t>((static_cast<std::int64_t>(a) * b) >> (fraction - 1));
+			if (type == 3) {
+				std::int32_t cube_real = static_cast<std::int32_t>((static_cast<std::int64_t>(real) * zx[lane] - static_cast<std::int64_t>(imaginary) * zy[lane]) >> fraction);
+				imaginary = static_cast<std::int32_t>((static_cast<std::int64_t>(imaginary) * zx[lane] + static_cast<std::int64_t>(real) * zy[lane]) >> fraction);
+				real = cube_real;
+			}
+			zx[lane] = active[lane] ? real + cx[lane] : zx[lane];
+			zy[lane] = active[lane] ? imaginary + cy[lane] : zy[lane];
+			steps[lane] += active[lane];
+			std::int32_t again = active[lane] & (zx[lane] == sx[lane]) & (zy[lane] == sy[lane]);
+			caught[lane] |= again;
+			active[lane] &= ~again;
+		}
+		if (i + 1 == next_save) {
+			for (int lane = 0; lane < thumbnail_lanes; ++lane) {
+				sx[lane] = zx[lane];
+				sy[lane] = zy[lane];
+			}
+			next_save *= 2;
+		}
+	}
+	for (int lane = 0; lane < thumbnail_lanes; ++lane) {
+		std::int64_t norm = static_cast<std::int64_t>(zx[lane]) * zx[lane] + static_cast<std::int64_t>(zy[lane]) * zy[lane];
+		bool escaped = !caught[lane] && (julia ? norm > limit : norm >= limit);
+		results[lane] = escaped ? std::make_pair(true, depth - steps[lane]) : std::make_pair(false, 0);
+	}
+}
+
+//Render a width x height thumbnail of view into out, one row per pool task, through the thumbnail kernel where
+//thumbnail_fits allows and render_rows where it does not. Pixels agree with render_rows to the kernel's 28 or so
+//bits, which at thumbnail sizes is well under a pixel.
+void render_thumbnail(const fractal_view& view, int width, int height, int* out, thread_pool& pool) {
+	if (!thumbnail_fits(view, width, height)) {
+		render_rows(view, width, height, 0, height, out, pool);
+		return;
+	}
+	int fraction = thumbnail_fraction(view.fractal_type);
+	std::int32_t kx = to_thumbnail(view.starting_point.real, fraction), ky = to_thumbnail(view.starting_point.imaginary, fraction);
+	pool.parallel_for(0, height, [&](int i) {
+		std::int32_t y = to_thumbnail(pixel_point(view, 0, i, width, height).imaginary, fraction);
+		for (int j0 = 0; j0 < width; j0 += thumbnail_lanes) {
+			//A short last batch repeats its last pixel
+			std::int32_t xs[thumbnail_lanes], ys[thumbnail_lanes];
+			for (int lane = 0; lane < thumbnail_lanes; ++lane) {
+				xs[lane] = to_thumbnail(pixel_point(view, std::min(j0 + lane, width - 1), i, width, height).real, fraction);
+				ys[lane] = y;
+			}
+			std::pair<bool, int> results[thumbnail_lanes];
+			escape_thumbnail_batch(view.fractal_type, kx, ky, xs, ys, view.maxiterations, fraction, results);
+			for (int lane = 0; lane < thumbnail_lanes && j0 + lane < width; ++lane)
+				out[static_cast<std::size_t>(i) * width + j0 + lane] = results[lane].first ? results[lane].second : interior;
+		}
+	});
+}
+
+//Entry point for "--thumbnails <width> <height> <views.txt> <prefix> [--scheme=n]": one PNG, prefix followed by
+//the view's number, for each line of views.txt that holds a view as view_to_string writes it. Blank lines and
+//'#' comments are skipped but still numbered, so a thumbnail's name gives the line it came from.
+int thumbnails_main(int argc, char** argv, const std::vector<gradient>& gradients, long double moddenom) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: --thumbnails <width> <height> <views.txt> <prefix> [--scheme=n]\n");
+		return 1;
+	}
+	int width = atoi(argv[0]), height = atoi(argv[1]);
+	std::string prefix = argv[3];
+	int scheme = 0;
+	for (int a = 4; a < argc; ++a) {
+		std::string arg = argv[a];
+		if (arg.compare(0, 9, "--scheme=") == 0)
+			scheme = atoi(arg.c_str() + 9);
+		else {
+			fprintf(stderr, "thumbnails: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (width <= 0 || height <= 0) {
+		fprintf(stderr, "thumbnails: width and height must be positive\n");
+		return 1;
+	}
+	FILE* list = open_file(argv[2], "r");
+	if (!list) {
+		fprintf(stderr, "thumbnails: cannot open %s\n", argv[2]);
+		return 1;
+	}
+	std::vector<int> iterations(static_cast<std::size_t>(width) * height);
+	std::vector<unsigned char> rgb(iterations.size() * 3);
+	char line[1024];
+	int number = 0, written = 0, fixed = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), list)) {
+		++number;
+		const char* pos = line;
+		while (*pos == ' ' || *pos == '\t')
+			++pos;
+		if (*pos == '#' || *pos == '\n' || *pos == '\r' || *pos == '\0')
+			continue;
+		fractal_view view;
+		if (!view_from_string(pos, view) || view.maxiterations <= 0) {
+			fprintf(stderr, "thumbnails: line %d is not a view\n", number);
+			ok = false;
+			continue;
+		}
+		fixed += thumbnail_fits(view, width, height);
+		render_thumbnail(view, width, height, &iterations[0], render_pool());
+		std::vector<unsigned char> palette = build_palette(gradients[scheme % gradients.size()], view.maxiterations, moddenom);
+		colorize(&iterations[0], iterations.size(), palette, &rgb[0]);
+		std::string png = encode_png(&rgb[0], width, height);
+		char name[32];
+		snprintf(name, sizeof(name), "%d.png", number);
+		FILE* file = open_file(prefix + name, "wb");
+		if (!file || fwrite(png.data(), 1, png.size(), file) != png.size()) {
+			fprintf(stderr, "thumbnails: cannot write %s%s\n", prefix.c_str(), name);
+			ok = false;
+		}
+		else
+			++written;
+		if (file)
+			fclose(file);
+	}
+	fclose(list);
+	fprintf(stderr, "thumbnails: %d written, %d of them in fixed point\n", written, fixed);
+	return ok ? 0 : 1;
+}
+
+#endif
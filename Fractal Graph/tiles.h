@@ -0,0 +1,582 @@
+#pragma once
+//Tiled rendering on a fixed lattice of the plane, so tiles from one view can be reused by the next
+#ifndef __TILES_H__
+#define __TILES_H__
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "render.h"
+#include "scanlines.h"
+
+//Side length of a lattice tile in pixels
+const int tile_size = 64;
+
+//Pixel sizes are snapped to steps of 2^(1/zoom_steps) so that returning to a view finds the same tiles
+const long double zoom_steps = 4096.0;
+
+//Lattice indices beyond this are too coarse to address a pixel exactly
+const long double lattice_limit = 4503599627370496.0; // 2^52
+
+//Quantized pixel size: level n means 2^(n / zoom_steps) units of the plane per pixel
+long long zoom_level(long double pixel) {
+	return llroundl(log2l(pixel) * zoom_steps);
+}
+
+long double level_size(long long level) {
+	return exp2l(static_cast<long double>(level) / zoom_steps);
+}
+
+//Floor division that rounds toward negative infinity for negative lattice indices too
+long long floor_div(long long a, long long b) {
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+//How a window of pixels sits on the lattice: pixel (j, i) samples the center of lattice cell (x0 + j, y0 + i)
+struct lattice_frame {
+	long long level_x;
+	long long level_y;
+	long double pixel_x;
+	long double pixel_y;
+	long long x0;
+	long long y0;
+	int width;
+	int height;
+};
+
+//Snap a view onto the lattice; returns false at zooms so deep that lattice indices would lose precision
+bool snap_to_lattice(const fractal_view& view, int width, int height, lattice_frame& frame) {
+	if (width <= 0 || height <= 0 || !(view.xmax > view.xmin) || !(view.ymax > view.ymin))
+		return false;
+	frame.level_x = zoom_level(view_width(view) / width);
+	frame.level_y = zoom_level(view_height(view) / height);
+	frame.pixel_x = level_size(frame.level_x);
+	frame.pixel_y = level_size(frame.level_y);
+	long double x0 = floorl(static_cast<long double>(view.xmin) / frame.pixel_x + 0.5);
+	long double y0 = floorl(static_cast<long double>(view.ymin) / frame.pixel_y + 0.5);
+	if (fabsl(x0) + width > lattice_limit || fabsl(y0) + height > lattice_limit)
+		return false;
+	frame.x0 = static_cast<long long>(x0);
+	frame.y0 = static_cast<long long>(y0);
+	frame.width = width;
+	frame.height = height;
+	return true;
+}
+
+//The point at the center of lattice cell index k along one axis
+long double lattice_point(long long k, long double pixel) {
+	return (static_cast<long double>(k) + 0.5) * pixel;
+}
+
+//Everything that decides a tile's contents
+struct tile_key {
+	int fractal_type;
+	long double start_real;
+	long double start_imaginary;
+	long long level_x;
+	long long level_y;
+	long long tx;
+	long long ty;
+	int maxiterations;
+	bool operator== (const tile_key& other) const {
+		return fractal_type == other.fractal_type && start_real == other.start_real && start_imaginary == other.start_imaginary
+			&& level_x == other.level_x && level_y == other.level_y && tx == other.tx && ty == other.ty && maxiterations == other.maxiterations;
+	}
+};
+
+struct tile_key_hash {
+	std::size_t operator() (const tile_key& key) const {
+		std::size_t h = std::hash<long double>()(key.start_real);
+		std::size_t parts[7] = { static_cast<std::size_t>(key.fractal_type), std::hash<long double>()(key.start_imaginary),
+			static_cast<std::size_t>(key.level_x), static_cast<std::size_t>(key.level_y),
+			static_cast<std::size_t>(key.tx), static_cast<std::size_t>(key.ty), static_cast<std::size_t>(key.maxiterations) };
+		for (int k = 0; k < 7; ++k)
+			h ^= parts[k] + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		return h;
+	}
+};
+
+//The key of lattice tile (tx, ty) under a given view and lattice
+tile_key make_tile_key(const fractal_view& view, const lattice_frame& frame, long long tx, long long ty) {
+	tile_key key;
+	key.fractal_type = view.fractal_type % 4;
+	key.start_real = view.starting_point.real;
+	key.start_imaginary = view.starting_point.imaginary;
+	key.level_x = frame.level_x;
+	key.level_y = frame.level_y;
+	key.tx = tx;
+	key.ty = ty;
+	key.maxiterations = view.maxiterations;
+	return key;
+}
+
+//Which escape kernel computed a tile. Raise it whenever a change to the kernels can change any pixel of a tile, so
+//tiles kept on disk from before are computed again rather than served.
+const int tile_kernel_version = 1;
+
+//tile_size x tile_size iteration values and continuous escape counts, row by row. Inside, the smooth channel holds
+//the interior distance in pixels where an attracting cycle gave one, and 0 where none was measured.
+struct tile {
+	std::vector<int> iterations;
+	std::vector<float> smooth;
+};
+
+//Symmetries of the escape counts that hold exactly, rounding and all, and carry the lattice onto itself.
+//Conjugation mirrors the Mandelbrot set from a real start and either Julia set of a real constant about the
+//real axis; the quadratic Julia map is even, so its sets survive a half turn. The cubic Julia sets' threefold
+//turn does not fit the lattice, and the burning ship has neither.
+const int mirror_symmetry = 1;
+const int half_turn_symmetry = 2;
+
+int lattice_symmetry(const tile_key& key) {
+	int found = 0;
+	if (key.fractal_type != 1 && key.start_imaginary == 0)
+		found |= mirror_symmetry;
+	if (key.fractal_type == 2)
+		found |= half_turn_symmetry;
+	return found;
+}
+
+//The tile a symmetry (any combination of the above) carries a tile to. Row k of the lattice is centered at
+//(k + 0.5) * pixel, so row k mirrors onto row -1 - k, and tile ty onto -1 - ty.
+tile_key symmetric_key(tile_key key, int symmetry) {
+	if (symmetry & mirror_symmetry)
+		key.ty = -1 - key.ty;
+	if (symmetry & half_turn_symmetry) {
+		key.tx = -1 - key.tx;
+		key.ty = -1 - key.ty;
+	}
+	return key;
+}
+
+//The contents of symmetric_key(key, symmetry) given those of key
+void symmetric_tile(const tile& from, tile& to, int symmetry) {
+	bool flip_x = (symmetry & half_turn_symmetry) != 0;
+	bool flip_y = ((symmetry & mirror_symmetry) != 0) != flip_x;
+	to.iterations.resize(tile_size * tile_size);
+	to.smooth.resize(tile_size * tile_size);
+	for (int b = 0; b < tile_size; ++b)
+		for (int a = 0; a < tile_size; ++a) {
+			int source = (flip_y ? tile_size - 1 - b : b) * tile_size + (flip_x ? tile_size - 1 - a : a);
+			to.iterations[b * tile_size + a] = from.iterations[source];
+			to.smooth[b * tile_size + a] = from.smooth[source];
+		}
+}
+
+//Iteration value and continuous escape count (or interior distance) of one lattice point
+void evaluate_lattice_point(const tile_key& key, const clong_double& start, const clong_double& dot, int& iterations, float& smooth) {
+	clong_double last;
+	int period;
+	long double inside = 0.0;
+	std::pair<bool, int> eval = escape(key.fractal_type, start, dot, escape_threshold, key.maxiterations, &last, &period, &inside,
+		cycle_tolerance(std::min(level_size(key.level_x), level_size(key.level_y))));
+	iterations = eval.first ? eval.second : interior;
+	smooth = eval.first ? smooth_count(key.fractal_type, key.maxiterations - eval.second, last) : static_cast<float>(inside / level_size(key.level_x));
+}
+
+//lattice_point in double-double, where (k + 0.5) * pixel is exact
+double_double deep_lattice_point(long long k, long double pixel) {
+	return (double_double(static_cast<double>(k)) + double_double(0.5)) * double_double(pixel);
+}
+
+//Iteration values and continuous counts of count points in the points' precision, streamed through
+//batch_lanes lanes
+template <class T>
+void evaluate_lattice_stream(const tile_key& key, const std::vector<basic_complex<T> >& points, int* iterations, float* smooth) {
+	int count = static_cast<int>(points.size());
+	std::vector<std::pair<bool, int> > results(count);
+	std::vector<basic_complex<T> > last(count);
+	std::vector<int> period(count);
+	std::vector<long double> inside(count, 0.0);
+	escape_stream<T, batch_lanes>(key.fractal_type, basic_complex<T>(clong_double(key.start_real, key.start_imaginary)), &points[0], count,
+		static_cast<T>(escape_threshold), key.maxiterations, &results[0], &last[0], &period[0], &inside[0],
+		cycle_tolerance(std::min(level_size(key.level_x), level_size(key.level_y))));
+	for (int k = 0; k < count; ++k) {
+		iterations[k] = results[k].first ? results[k].second : interior;
+		smooth[k] = results[k].first ? smooth_count(key.fractal_type, key.maxiterations - results[k].second, clong_double(last[k]))
+			: static_cast<float>(inside[k] / level_size(key.level_x));
+	}
+}
+
+//evaluate_lattice_point for the count lattice points (columns[k], rows[k]), into iterations[k] and smooth[k].
+//Points too finely spaced for long double go in double-double. Lists long enough to fill the lanes are
+//streamed; shorter ones of long doubles go point by point.
+void evaluate_lattice_points(const tile_key& key, const long long* columns, const long long* rows, int count, int* iterations, float* smooth) {
+	if (count == 0)
+		return;
+	long double pixel_x = level_size(key.level_x), pixel_y = level_size(key.level_y);
+	long double reach = 0;
+	for (int k = 0; k < count; ++k)
+		reach = std::max(reach, std::max(fabsl(lattice_point(columns[k], pixel_x)), fabsl(lattice_point(rows[k], pixel_y))));
+	if (deep_pixels(reach, std::min(pixel_x, pixel_y))) {
+		std::vector<cdouble_double> points(count);
+		for (int k = 0; k < count; ++k)
+			points[k] = cdouble_double(deep_lattice_point(columns[k], pixel_x), deep_lattice_point(rows[k], pixel_y));
+		evaluate_lattice_stream(key, points, iterations, smooth);
+	}
+	else if (count < batch_lanes) {
+		for (int k = 0; k < count; ++k)
+			evaluate_lattice_point(key, clong_double(key.start_real, key.start_imaginary),
+				clong_double(lattice_point(columns[k], pixel_x), lattice_point(rows[k], pixel_y)), iterations[k], smooth[k]);
+	}
+	else {
+		std::vector<clong_double> points(count);
+		for (int k = 0; k < count; ++k)
+			points[k] = clong_double(lattice_point(columns[k], pixel_x), lattice_point(rows[k], pixel_y));
+		evaluate_lattice_stream(key, points, iterations, smooth);
+	}
+}
+
+//Rows of a tile streamed together between checks for abandoning it
+const int tile_stream_rows = 8;
+
+//Compute one lattice tile. If known is given, out already holds the pixels it marks and only the others are
+//evaluated. Rectangles interval iteration proves interior are filled without evaluating their pixels; those
+//proved to escape still are, for their continuous counts. The rectangles are taken from the exact lattice
+//points, rounded outward, so they hold the points whether evaluated in long double or double-double. If abandon is given and becomes true the tile is
+//given up between groups of rows and false returned.
+bool compute_tile(const tile_key& key, tile& out, const std::atomic<bool>* abandon = NULL, const unsigned char* known = NULL) {
+	out.iterations.resize(tile_size * tile_size);
+	out.smooth.resize(tile_size * tile_size);
+	long double pixel_x = level_size(key.level_x), pixel_y = level_size(key.level_y);
+	clong_double start(key.start_real, key.start_imaginary);
+	std::vector<unsigned char> settled(tile_size * tile_size, 0);
+	settle_block(key.fractal_type, start, escape_threshold, key.maxiterations, false, 0, 0, tile_size, tile_size, tile_size,
+		[&](int a, int b) { return cdouble_double(deep_lattice_point(key.tx * tile_size + a, pixel_x), deep_lattice_point(key.ty * tile_size + b, pixel_y)); },
+		&out.iterations[0], &settled[0]);
+	for (int b0 = 0; b0 < tile_size; b0 += tile_stream_rows) {
+		if (abandon && *abandon)
+			return false;
+		//The pixels of these rows still to evaluate, gathered into one worklist
+		long long columns[tile_stream_rows * tile_size], rows[tile_stream_rows * tile_size];
+		int places[tile_stream_rows * tile_size];
+		int count = 0;
+		for (int b = b0; b < std::min(b0 + tile_stream_rows, tile_size); ++b)
+			for (int a = 0; a < tile_size; ++a)
+				if (settled[b * tile_size + a])
+					out.smooth[b * tile_size + a] = 0.0f;
+				else if (!known || !known[b * tile_size + a]) {
+					columns[count] = key.tx * tile_size + a;
+					rows[count] = key.ty * tile_size + b;
+					places[count++] = b * tile_size + a;
+				}
+		int iterations[tile_stream_rows * tile_size];
+		float smooth[tile_stream_rows * tile_size];
+		evaluate_lattice_points(key, columns, rows, count, iterations, smooth);
+		for (int k = 0; k < count; ++k) {
+			out.iterations[places[k]] = iterations[k];
+			out.smooth[places[k]] = smooth[k];
+		}
+	}
+	return true;
+}
+
+//Mark in known, and fill in as interior, the pixels of a tile the scanline cache already knows to be interior.
+//Returns how many there were.
+int prefill_interior(const fractal_view& view, const tile_key& key, scanline_cache& scanlines, tile& out, std::vector<unsigned char>& known) {
+	long double pixel_x = level_size(key.level_x), pixel_y = level_size(key.level_y);
+	std::vector<unsigned char> row(tile_size);
+	int marked = 0;
+	for (int b = 0; b < tile_size; ++b) {
+		std::fill(row.begin(), row.end(), 0);
+		if (!scanlines.interior_row(view, lattice_point(key.ty * tile_size + b, pixel_y), lattice_point(key.tx * tile_size, pixel_x), pixel_x, tile_size, &row[0]))
+			continue;
+		if (known.empty()) {
+			known.assign(tile_size * tile_size, 0);
+			out.iterations.resize(tile_size * tile_size);
+			out.smooth.resize(tile_size * tile_size);
+		}
+		for (int a = 0; a < tile_size; ++a)
+			if (row[a] && !known[b * tile_size + a]) {
+				known[b * tile_size + a] = 1;
+				out.iterations[b * tile_size + a] = interior;
+				out.smooth[b * tile_size + a] = 0.0f;
+				++marked;
+			}
+	}
+	return marked;
+}
+
+//Record every row of a finished tile in the scanline cache
+void record_tile(const fractal_view& view, const tile_key& key, const tile& done, scanline_cache& scanlines) {
+	long double pixel_x = level_size(key.level_x), pixel_y = level_size(key.level_y);
+	for (int b = 0; b < tile_size; ++b)
+		scanlines.record(view, lattice_point(key.ty * tile_size + b, pixel_y), lattice_point(key.tx * tile_size, pixel_x), pixel_x,
+			&done.iterations[b * tile_size], tile_size);
+}
+
+//Pixels of one window already evaluated at their lattice centers, for instance while sampling, which an
+//exhaustive render of the same window need not evaluate again. known is 1 where a pixel was evaluated and 2 where
+//the scanline cache only guessed it interior; the exhaustive render takes the first kind alone.
+struct sampled_frame {
+	fractal_view view;
+	lattice_frame frame;
+	std::vector<int> iterations;
+	std::vector<float> smooth;
+	std::vector<unsigned char> known;
+	long long count;
+};
+
+//Start over with nothing known about the given window
+void reset_samples(sampled_frame& samples, const fractal_view& view, const lattice_frame& frame) {
+	std::size_t pixels = static_cast<std::size_t>(frame.width) * frame.height;
+	samples.view = view;
+	samples.frame = frame;
+	samples.iterations.assign(pixels, interior);
+	samples.smooth.assign(pixels, 0.0f);
+	samples.known.assign(pixels, 0);
+	samples.count = 0;
+}
+
+//Iteration value of pixel (j, i) of the sampled window, evaluating it at its lattice center the first time unless
+//the scanline cache, if given, knows it is interior
+int sample_pixel(sampled_frame& samples, int j, int i, scanline_cache* scanlines = NULL) {
+	std::size_t p = static_cast<std::size_t>(i) * samples.frame.width + j;
+	if (!samples.known[p]) {
+		tile_key key = make_tile_key(samples.view, samples.frame, 0, 0);
+		clong_double dot(lattice_point(samples.frame.x0 + j, samples.frame.pixel_x), lattice_point(samples.frame.y0 + i, samples.frame.pixel_y));
+		if (scanlines && scanlines->interior_at(samples.view, dot)) {
+			samples.iterations[p] = interior;
+			samples.known[p] = 2;
+		}
+		else {
+			long long column = samples.frame.x0 + j, row = samples.frame.y0 + i;
+			evaluate_lattice_points(key, &column, &row, 1, &samples.iterations[p], &samples.smooth[p]);
+			samples.known[p] = 1;
+		}
+		++samples.count;
+	}
+	return samples.iterations[p];
+}
+
+//Tiles kept in memory up to a byte budget, least recently used thrown out first
+class tile_cache {
+public:
+	tile_cache(std::size_t budget_) : budget(budget_) { used = 0; }
+	//Copy a cached tile into out and mark it recently used; false if it is not cached
+	bool find(const tile_key& key, tile& out) {
+		std::lock_guard<std::mutex> lock(guard);
+		index_type::iterator found = index.find(key);
+		if (found == index.end())
+			return false;
+		entries.splice(entries.begin(), entries, found->second);
+		out = found->second->second;
+		return true;
+	}
+	bool contains(const tile_key& key) {
+		std::lock_guard<std::mutex> lock(guard);
+		return index.count(key) > 0;
+	}
+	void insert(const tile_key& key, const tile& value) {
+		std::lock_guard<std::mutex> lock(guard);
+		index_type::iterator found = index.find(key);
+		if (found != index.end()) {
+			used -= bytes(found->second->second);
+			entries.erase(found->second);
+			index.erase(found);
+		}
+		entries.push_front(std::make_pair(key, value));
+		index[key] = entries.begin();
+		used += bytes(value);
+		while (used > budget && entries.size() > 1) {
+			used -= bytes(entries.back().second);
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+	}
+	void clear() {
+		std::lock_guard<std::mutex> lock(guard);
+		entries.clear();
+		index.clear();
+		used = 0;
+	}
+	std::size_t size() {
+		std::lock_guard<std::mutex> lock(guard);
+		return entries.size();
+	}
+private:
+	typedef std::list<std::pair<tile_key, tile> > entry_list;
+	typedef std::unordered_map<tile_key, entry_list::iterator, tile_key_hash> index_type;
+	// REPRESENTATION
+	entry_list entries;
+	index_type index;
+	std::size_t budget;
+	std::size_t used;
+	std::mutex guard;
+	static std::size_t bytes(const tile& value) { return value.iterations.size() * sizeof(int) + value.smooth.size() * sizeof(float) + sizeof(tile_key) + 96; }
+};
+
+//Somewhere slower than memory to keep tiles, such as a file; loads and saves may come from several threads
+class tile_backing {
+public:
+	virtual ~tile_backing() {}
+	virtual bool load(const tile_key& key, tile& out) = 0;
+	virtual void save(const tile_key& key, const tile& value) = 0;
+};
+
+//Make out a cached tile's image under a symmetry of key, and cache it under key; false if there is none
+bool find_symmetric(tile_cache& cache, const tile_key& key, tile& out) {
+	int symmetry = lattice_symmetry(key);
+	for (int s = 1; s <= 3; ++s) {
+		tile image;
+		if ((s & ~symmetry) || !cache.find(symmetric_key(key, s), image))
+			continue;
+		symmetric_tile(image, out, s);
+		cache.insert(key, out);
+		return true;
+	}
+	return false;
+}
+
+//Render a window of the lattice into out (width x height), taking every tile it can from the cache, then from
+//the backing store if there is one, and computing the rest on the pool. Samples of the same window, if given,
+//are not evaluated again, and tiles their iterations say are dearest start first so the pool finishes evenly.
+//With a scanline cache, pixels it knows to be interior are not evaluated either, and every new tile is recorded
+//in it. Those pixels are guesses, so a tile with any is shown but neither cached, saved nor recorded. Of tiles
+//that are images of each other under a symmetry of the fractal only one is computed, and a tile whose image is
+//cached is not computed at all. Given wanted, a mask over the window, only tiles holding a wanted pixel are
+//filled in and the rest of out is left as it was. Returns the number of tiles computed.
+int render_tiles(const fractal_view& view, const lattice_frame& frame, tile_cache& cache, int* out, thread_pool& pool,
+	tile_backing* backing = NULL, const sampled_frame* samples = NULL, scanline_cache* scanlines = NULL, const unsigned char* wanted = NULL) {
+	long long tx0 = floor_div(frame.x0, tile_size), tx1 = floor_div(frame.x0 + frame.width - 1, tile_size);
+	long long ty0 = floor_div(frame.y0, tile_size), ty1 = floor_div(frame.y0 + frame.height - 1, tile_size);
+	int across = static_cast<int>(tx1 - tx0 + 1);
+	int count = across * static_cast<int>(ty1 - ty0 + 1);
+	std::vector<int> missing;
+	std::vector<tile> tiles(count);
+	std::vector<unsigned char> skipped(count, 0);
+	for (int t = 0; wanted && t < count; ++t) {
+		long long left = (tx0 + t % across) * tile_size - frame.x0;
+		long long top = (ty0 + t / across) * tile_size - frame.y0;
+		bool any = false;
+		for (long long i = std::max(0LL, top); !any && i < std::min<long long>(frame.height, top + tile_size); ++i)
+			for (long long j = std::max(0LL, left); !any && j < std::min<long long>(frame.width, left + tile_size); ++j)
+				any = wanted[static_cast<std::size_t>(i) * frame.width + j] != 0;
+		skipped[t] = !any;
+	}
+	for (int t = 0; t < count; ++t)
+		if (!skipped[t] && !cache.find(make_tile_key(view, frame, tx0 + t % across, ty0 + t / across), tiles[t])
+			&& !find_symmetric(cache, make_tile_key(view, frame, tx0 + t % across, ty0 + t / across), tiles[t]))
+			missing.push_back(t);
+	//Where each missing tile's samples are, and what they say it will cost
+	std::vector<std::vector<unsigned char> > known(count);
+	if (samples && !missing.empty()) {
+		std::vector<double> cost(count, -1.0);
+		double total = 0.0;
+		int estimated = 0;
+		for (std::size_t m = 0; m < missing.size(); ++m) {
+			int t = missing[m];
+			long long left = (tx0 + t % across) * tile_size - frame.x0;
+			long long top = (ty0 + t / across) * tile_size - frame.y0;
+			double sum = 0.0;
+			int seen = 0;
+			for (int b = 0; b < tile_size; ++b)
+				for (int a = 0; a < tile_size; ++a) {
+					long long i = top + b, j = left + a;
+					if (i < 0 || j < 0 || i >= frame.height || j >= frame.width)
+						continue;
+					std::size_t p = static_cast<std::size_t>(i) * frame.width + j;
+					if (samples->known[p] != 1)
+						continue;
+					if (known[t].empty()) {
+						known[t].assign(tile_size * tile_size, 0);
+						tiles[t].iterations.resize(tile_size * tile_size);
+						tiles[t].smooth.resize(tile_size * tile_size);
+					}
+					known[t][b * tile_size + a] = 1;
+					tiles[t].iterations[b * tile_size + a] = samples->iterations[p];
+					tiles[t].smooth[b * tile_size + a] = samples->smooth[p];
+					//Steps taken: an escaped point took maxiterations less its value, an interior one all of them
+					sum += (samples->iterations[p] == interior) ? view.maxiterations : view.maxiterations - samples->iterations[p];
+					++seen;
+				}
+			if (seen) {
+				cost[t] = sum / seen;
+				total += cost[t];
+				++estimated;
+			}
+		}
+		//Tiles nobody sampled are taken to be average
+		for (std::size_t m = 0; m < missing.size(); ++m)
+			if (cost[missing[m]] < 0)
+				cost[missing[m]] = estimated ? total / estimated : 0.0;
+		std::stable_sort(missing.begin(), missing.end(), [&](int a, int b) { return cost[a] > cost[b]; });
+	}
+	//Split off the missing tiles that are images of others missing; each is made from the first of its kind
+	std::unordered_map<tile_key, int, tile_key_hash> missing_at;
+	for (std::size_t m = 0; m < missing.size(); ++m)
+		missing_at[make_tile_key(view, frame, tx0 + missing[m] % across, ty0 + missing[m] / across)] = missing[m];
+	std::vector<int> computing;
+	std::vector<std::pair<int, std::pair<int, int> > > images;
+	std::vector<unsigned char> taken(count, 0);
+	for (std::size_t m = 0; m < missing.size(); ++m) {
+		int t = missing[m];
+		if (taken[t])
+			continue;
+		taken[t] = 1;
+		computing.push_back(t);
+		tile_key key = make_tile_key(view, frame, tx0 + t % across, ty0 + t / across);
+		int symmetry = lattice_symmetry(key);
+		for (int s = 1; s <= 3; ++s) {
+			if (s & ~symmetry)
+				continue;
+			std::unordered_map<tile_key, int, tile_key_hash>::const_iterator image = missing_at.find(symmetric_key(key, s));
+			if (image != missing_at.end() && !taken[image->second]) {
+				taken[image->second] = 1;
+				images.push_back(std::make_pair(image->second, std::make_pair(t, s)));
+			}
+		}
+	}
+	std::atomic<int> computed(0);
+	std::vector<unsigned char> guessed(count, 0);
+	pool.parallel_for(0, static_cast<int>(computing.size()), [&](int m) {
+		int t = computing[m];
+		tile_key key = make_tile_key(view, frame, tx0 + t % across, ty0 + t / across);
+		if (!backing || !backing->load(key, tiles[t])) {
+			guessed[t] = scanlines && prefill_interior(view, key, *scanlines, tiles[t], known[t]) > 0;
+			compute_tile(key, tiles[t], NULL, known[t].empty() ? NULL : &known[t][0]);
+			++computed;
+			if (guessed[t])
+				return;
+			if (backing)
+				backing->save(key, tiles[t]);
+		}
+		if (scanlines)
+			record_tile(view, key, tiles[t], *scanlines);
+		cache.insert(key, tiles[t]);
+	});
+	for (std::size_t k = 0; k < images.size(); ++k) {
+		int t = images[k].first;
+		tile_key key = make_tile_key(view, frame, tx0 + t % across, ty0 + t / across);
+		symmetric_tile(tiles[images[k].second.first], tiles[t], images[k].second.second);
+		if (guessed[images[k].second.first])
+			continue;
+		if (backing)
+			backing->save(key, tiles[t]);
+		if (scanlines)
+			record_tile(view, key, tiles[t], *scanlines);
+		cache.insert(key, tiles[t]);
+	}
+	//Copy the visible part of every tile into the window
+	for (int t = 0; t < count; ++t) {
+		if (skipped[t])
+			continue;
+		long long left = (tx0 + t % across) * tile_size - frame.x0;
+		long long top = (ty0 + t / across) * tile_size - frame.y0;
+		for (int b = 0; b < tile_size; ++b) {
+			long long i = top + b;
+			if (i < 0 || i >= frame.height)
+				continue;
+			int a0 = static_cast<int>(std::max(0LL, -left));
+			int a1 = static_cast<int>(std::min<long long>(tile_size, frame.width - left));
+			if (a1 > a0)
+				std::copy(tiles[t].iterations.begin() + b * tile_size + a0, tiles[t].iterations.begin() + b * tile_size + a1, out + i * frame.width + left + a0);
+		}
+	}
+	return computed;
+}
+
+#endif
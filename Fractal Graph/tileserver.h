@@ -0,0 +1,257 @@
+#pragma once
+//Tile server: serves /{fractal}/{z}/{x}/{y}.png slippy-map tiles on localhost, rendering each tile once
+#ifndef __TILESERVER_H__
+#define __TILESERVER_H__
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "net.h"
+#include "pngwrite.h"
+#include "render.h"
+#include "threadpool.h"
+
+//Side length of a served tile in pixels
+const int map_tile_size = 256;
+
+//Zoom 0 is one tile covering this square of the plane
+const long double map_left = -2.5;
+const long double map_top = -2.0;
+const long double map_side = 4.0;
+
+//Deepest zoom served. Tile corners are taken in double-double, and pixels are kept at least 4 of its units in the
+//last place apart at the map's largest coordinate; and a tile's pixel coordinates, which the corners and a
+//browser's map both work from, must stay exact in a double.
+int map_max_zoom() {
+	long double reach = std::max(std::max(fabsl(map_left), fabsl(map_left + map_side)), std::max(fabsl(map_top), fabsl(map_top + map_side)));
+	int precise = static_cast<int>(floorl(log2l(map_side / map_tile_size / (4 * reach * DBL_EPSILON * DBL_EPSILON))));
+	int exact = DBL_MANT_DIG - static_cast<int>(ceill(log2l(map_tile_size)));
+	return std::min(precise, exact);
+}
+
+//Connections answered at once, and connections left waiting for one of them before more are turned away
+const int map_connection_threads = 16;
+const int map_connection_backlog = 256;
+
+//Names accepted in the first path segment, in fractal_type order
+const char* map_fractal_names[4] = { "mandelbrot", "burningship", "julia", "julia3" };
+
+//Turn the {fractal} path segment into a fractal_type; a bare number also works
+int map_fractal_type(const std::string& name) {
+	for (int k = 0; k < 4; ++k)
+		if (name == map_fractal_names[k])
+			return k;
+	char* end;
+	long type = strtol(name.c_str(), &end, 10);
+	return (!name.empty() && *end == '\0' && type >= 0) ? static_cast<int>(type % 4) : -1;
+}
+
+//Finished PNG tiles plus tiles still being rendered. A request for a tile that is in flight waits on the
+//same future instead of rendering it again, and only finished tiles are forgotten, so each tile is rendered
+//exactly once while it stays cached.
+class tile_server {
+public:
+	tile_server(const fractal_view& base_, const gradient& scheme, long double moddenom, std::size_t capacity_)
+		: base(base_), capacity(capacity_) {
+		palette = build_palette(scheme, base.maxiterations, moddenom);
+		rendered = 0;
+	}
+	//PNG bytes for a tile, rendering it if nobody has yet. A render that throws passes its exception to everyone
+	//waiting on the tile and is forgotten, so the next request tries again.
+	std::string tile(int type, int z, long long x, long long y) {
+		char key[96];
+		snprintf(key, sizeof(key), "%d/%d/%lld/%lld", type, z, x, y);
+		std::shared_ptr<std::promise<std::string> > mine;
+		std::shared_future<std::string> result;
+		{
+			std::lock_guard<std::mutex> lock(guard);
+			std::map<std::string, std::shared_future<std::string> >::iterator found = tiles.find(key);
+			if (found != tiles.end())
+				result = found->second;
+			else {
+				mine.reset(new std::promise<std::string>());
+				result = mine->get_future().share();
+				tiles[key] = result;
+				order.push_back(key);
+				//Forget the oldest finished tiles once over capacity; tiles in flight do not count against it
+				for (std::deque<std::string>::iterator old = order.begin(); order.size() > capacity && old != order.end();) {
+					std::map<std::string, std::shared_future<std::string> >::iterator entry = tiles.find(*old);
+					if (entry->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+						tiles.erase(entry);
+						old = order.erase(old);
+					}
+					else
+						++old;
+				}
+			}
+		}
+		if (mine) {
+			try {
+				mine->set_value(render(type, z, x, y));
+			}
+			catch (...) {
+				mine->set_exception(std::current_exception());
+				std::lock_guard<std::mutex> lock(guard);
+				tiles.erase(key);
+				order.erase(std::find(order.begin(), order.end(), std::string(key)));
+				fprintf(stderr, "serve: failed to render %s\n", key);
+				return result.get();
+			}
+			std::lock_guard<std::mutex> lock(guard);
+			fprintf(stderr, "serve: rendered %s (%lld so far)\n", key, ++rendered);
+		}
+		return result.get();
+	}
+private:
+	// REPRESENTATION
+	fractal_view base;
+	std::vector<unsigned char> palette;
+	std::size_t capacity;
+	std::map<std::string, std::shared_future<std::string> > tiles;
+	std::deque<std::string> order;
+	long long rendered;
+	std::mutex guard;
+	std::string render(int type, int z, long long x, long long y) {
+		long double side = map_side / static_cast<long double>(1LL << z);
+		fractal_view view = base;
+		view.fractal_type = type;
+		view.xmin = double_double(map_left) + double_double(static_cast<double>(x)) * double_double(side);
+		view.xmax = view.xmin + double_double(side);
+		view.ymin = double_double(map_top) + double_double(static_cast<double>(y)) * double_double(side);
+		view.ymax = view.ymin + double_double(side);
+		std::vector<int> iterations(map_tile_size * map_tile_size);
+		render_block(view, map_tile_size, map_tile_size, 0, 0, map_tile_size, map_tile_size, &iterations[0], render_pool());
+		std::vector<unsigned char> rgb(iterations.size() * 3);
+		colorize(&iterations[0], iterations.size(), palette, &rgb[0]);
+		return encode_png(&rgb[0], map_tile_size, map_tile_size);
+	}
+};
+
+//A tiny Leaflet page so the server can be explored straight from a browser
+std::string map_index_page() {
+	return "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>Fractal map</title>"
+		"<link rel=\"stylesheet\" href=\"https://unpkg.com/leaflet@1.9.4/dist/leaflet.css\">"
+		"<script src=\"https://unpkg.com/leaflet@1.9.4/dist/leaflet.js\"></script>"
+		"<style>html,body,#map{height:100%;margin:0}</style></head><body><div id=\"map\"></div><script>"
+		"var map=L.map('map',{crs:L.CRS.Simple,minZoom:0,maxZoom:" + std::to_string(map_max_zoom()) + "}).setView([-128,128],1);"
+		"L.tileLayer('/mandelbrot/{z}/{x}/{y}.png',{tileSize:256,noWrap:true,maxZoom:" + std::to_string(map_max_zoom()) + ","
+		"bounds:[[0,0],[-256,256]]}).addTo(map);</script></body></html>";
+}
+
+//Only tiles are worth caching; a failed render may well succeed next time
+void send_response(socket_handle s, const char* status, const char* type, const std::string& body) {
+	char head[256];
+	snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %lld\r\n"
+		"Access-Control-Allow-Origin: *\r\nCache-Control: %s\r\nConnection: close\r\n\r\n",
+		status, type, static_cast<long long>(body.size()), (status[0] == '2') ? "public, max-age=86400" : "no-store");
+	if (send_all(s, head, strlen(head)))
+		send_all(s, body.data(), body.size());
+}
+
+//Answer one HTTP request, then hang up
+void serve_http(tile_server* server, socket_handle s) {
+	std::string request, line;
+	bool ok = recv_line(s, request);
+	//Skip the headers; nothing in them changes the answer
+	while (ok && recv_line(s, line) && !line.empty());
+	std::string path;
+	if (ok && request.compare(0, 4, "GET ") == 0)
+		path = request.substr(4, request.find(' ', 4) - 4);
+	path = path.substr(0, path.find('?'));
+	if (path == "/" || path == "/index.html") {
+		send_response(s, "200 OK", "text/html", map_index_page());
+		close_socket(s);
+		return;
+	}
+	//"/{fractal}/{z}/{x}/{y}.png"
+	std::size_t a = path.find('/', 1);
+	int type = (a == std::string::npos) ? -1 : map_fractal_type(path.substr(1, a - 1));
+	long long zxy[3];
+	const char* rest = (type < 0) ? NULL : path.c_str() + a;
+	for (int k = 0; k < 3 && rest; ++k) {
+		char* end;
+		zxy[k] = (*rest == '/') ? strtoll(rest + 1, &end, 10) : -1;
+		rest = (*rest == '/' && end != rest + 1) ? end : NULL;
+	}
+	if (!rest || strcmp(rest, ".png") != 0)
+		send_response(s, "404 Not Found", "text/plain", "expected /{fractal}/{z}/{x}/{y}.png\n");
+	else if (zxy[0] < 0 || zxy[0] > map_max_zoom() || zxy[1] < 0 || zxy[2] < 0 || zxy[1] >= (1LL << zxy[0]) || zxy[2] >= (1LL << zxy[0]))
+		send_response(s, "400 Bad Request", "text/plain", "tile out of range\n");
+	else {
+		std::string png;
+		try {
+			png = server->tile(type, static_cast<int>(zxy[0]), zxy[1], zxy[2]);
+		}
+		catch (...) {
+			send_response(s, "500 Internal Server Error", "text/plain", "tile could not be rendered\n");
+			close_socket(s);
+			return;
+		}
+		send_response(s, "200 OK", "image/png", png);
+	}
+	close_socket(s);
+}
+
+//Entry point for "--serve <port> [--cache=tiles] [--scheme=n] [--iter=n] [--start=re,im]"
+int tileserver_main(int argc, char** argv, const fractal_view& defaults, const std::vector<gradient>& gradients, long double moddenom) {
+	if (argc < 1) {
+		fprintf(stderr, "usage: --serve <port> [--cache=tiles] [--scheme=n] [--iter=n] [--start=re,im]\n");
+		return 1;
+	}
+	fractal_view base = defaults;
+	int port = atoi(argv[0]);
+	int scheme = 0;
+	long long capacity = 4096;
+	for (int a = 1; a < argc; ++a) {
+		std::string arg = argv[a];
+		if (arg.compare(0, 8, "--cache=") == 0)
+			capacity = atoll(arg.c_str() + 8);
+		else if (arg.compare(0, 9, "--scheme=") == 0)
+			scheme = atoi(arg.c_str() + 9);
+		else if (!parse_view_option(arg, base)) {
+			fprintf(stderr, "serve: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (capacity < 1 || base.maxiterations <= 0) {
+		fprintf(stderr, "serve: cache size and iterations must be positive\n");
+		return 1;
+	}
+	socket_handle listener = listen_on(port, true);
+	if (listener == no_socket) {
+		fprintf(stderr, "serve: cannot listen on port %d\n", port);
+		return 1;
+	}
+	tile_server server(base, gradients[scheme % gradients.size()], moddenom, static_cast<std::size_t>(capacity));
+	//Connections get their own pool: their renders fan out on render_pool(), which they must not wait inside
+	thread_pool connections(map_connection_threads);
+	std::atomic<int> waiting(0);
+	fprintf(stderr, "serve: http://127.0.0.1:%d/ (zoom 0 to %d)\n", local_port(listener), map_max_zoom());
+	while (true) {
+		socket_handle s = accept_within(listener, 1000);
+		if (s == no_socket)
+			continue;
+		if (waiting >= map_connection_backlog) {
+			send_response(s, "503 Service Unavailable", "text/plain", "busy\n");
+			close_socket(s);
+			continue;
+		}
+		++waiting;
+		connections.submit([&server, &waiting, s]() {
+			--waiting;
+			serve_http(&server, s);
+		});
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,360 @@
+#pragma once
+//Tile store: lattice tiles kept on disk between sessions, in an append-only data file with a memory-mapped index
+#ifndef __TILESTORE_H__
+#define __TILESTORE_H__
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+#include "mappedfile.h"
+#include "tiles.h"
+#include "varint.h"
+
+//An exclusive lock on a file, refused while another process holds it and given up on release or exit
+class file_lock {
+public:
+	file_lock() { handle_init(); }
+	~file_lock() { release(); }
+	//Take the lock on path, creating the file if need be; false if it is held elsewhere
+	bool acquire(const std::string& path) {
+		release();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		OVERLAPPED whole;
+		memset(&whole, 0, sizeof(whole));
+		if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &whole)) {
+			release();
+			return false;
+		}
+#else
+		file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (file < 0)
+			return false;
+		if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+			release();
+			return false;
+		}
+#endif
+		return true;
+	}
+	//Closing the file gives the lock up
+	void release() {
+#ifdef _WIN32
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (file >= 0)
+			::close(file);
+#endif
+		handle_init();
+	}
+private:
+	// REPRESENTATION
+#ifdef _WIN32
+	HANDLE file;
+	void handle_init() { file = INVALID_HANDLE_VALUE; }
+#else
+	int file;
+	void handle_init() { file = -1; }
+#endif
+	file_lock(const file_lock&);
+	file_lock& operator= (const file_lock&);
+};
+
+//A tile_key laid out the same on every compiler, with the kernel version that computed the tile; long doubles are
+//split into a double and the remainder
+struct stored_key {
+	std::int32_t version;
+	std::int32_t fractal_type;
+	std::int32_t maxiterations;
+	std::int32_t reserved;
+	std::int64_t level_x;
+	std::int64_t level_y;
+	std::int64_t tx;
+	std::int64_t ty;
+	double start[4];
+};
+
+stored_key store_key(const tile_key& key) {
+	stored_key stored;
+	memset(&stored, 0, sizeof(stored));
+	stored.version = tile_kernel_version;
+	stored.fractal_type = key.fractal_type;
+	stored.maxiterations = key.maxiterations;
+	stored.level_x = key.level_x;
+	stored.level_y = key.level_y;
+	stored.tx = key.tx;
+	stored.ty = key.ty;
+	stored.start[0] = static_cast<double>(key.start_real);
+	stored.start[1] = static_cast<double>(key.start_real - stored.start[0]);
+	stored.start[2] = static_cast<double>(key.start_imaginary);
+	stored.start[3] = static_cast<double>(key.start_imaginary - stored.start[2]);
+	return stored;
+}
+
+//FNV-1a over the key's bytes
+std::uint64_t stored_key_hash(const stored_key& key) {
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+	std::uint64_t h = 14695981039346656037ULL;
+	for (std::size_t k = 0; k < sizeof(key); ++k)
+		h = (h ^ bytes[k]) * 1099511628211ULL;
+	return h;
+}
+
+//Index file: this header, then an open-addressed hash table of entries
+struct index_header {
+	char magic[8];
+	std::uint64_t capacity;
+	std::uint64_t count;
+	//Every record before this offset in the data file is in the index
+	std::uint64_t data_end;
+};
+
+struct index_entry {
+	stored_key key;
+	std::uint64_t offset;
+	std::uint32_t length;
+	std::uint32_t used;
+};
+
+//Each data record is this header followed by length bytes of packed tile
+struct record_header {
+	char magic[4];
+	std::uint32_t length;
+	stored_key key;
+};
+
+//Both name the layout; stores in an older one are started again
+const char index_magic[8] = { 'F', 'R', 'A', 'C', 'I', 'D', 'X', '2' };
+const char record_magic[4] = { 'T', 'I', 'L', '2' };
+
+//Smooth values are stored as the varint of their bits xor the previous pixel's. Both channels round-trip exactly.
+std::string pack_tile(const tile& value) {
+	std::string out;
+	out.reserve(value.iterations.size() * 3);
+	compress_iterations(value.iterations.data(), value.iterations.size(), out);
+	std::uint32_t before = 0;
+	for (std::size_t p = 0; p < value.smooth.size(); ++p) {
+		std::uint32_t bits;
+		memcpy(&bits, &value.smooth[p], sizeof(bits));
+		put_varint(out, bits ^ before);
+		before = bits;
+	}
+	return out;
+}
+
+bool unpack_tile(const unsigned char* pos, std::size_t length, tile& out) {
+	const unsigned char* end = pos + length;
+	out.iterations.resize(tile_size * tile_size);
+	out.smooth.resize(tile_size * tile_size);
+	if (!expand_iterations(pos, end, out.iterations.data(), out.iterations.size()))
+		return false;
+	std::uint32_t before = 0;
+	std::uint64_t value;
+	for (std::size_t p = 0; p < out.smooth.size(); ++p) {
+		if (!get_varint(pos, end, value))
+			return false;
+		before ^= static_cast<std::uint32_t>(value);
+		memcpy(&out.smooth[p], &before, sizeof(before));
+	}
+	return pos == end;
+}
+
+//Tiles on disk under <base>.dat and <base>.idx. The data file is only ever appended to; the index is rebuilt
+//from it whenever it is missing, damaged or behind, so a crash loses at most the tile being written. Only one
+//process at a time has a store open, by an exclusive lock on <base>.lock; each appends at the end it knows of.
+//Tiles are only served to the kernel version that computed them.
+class tile_store : public tile_backing {
+public:
+	tile_store() { data = NULL; locked_out = false; }
+	~tile_store() { close(); }
+	//False if the store cannot be opened, or if another process has it open, which held() then says
+	bool open(const std::string& base_) {
+		std::lock_guard<std::mutex> lock(guard);
+		close_files();
+		base = base_;
+		locked_out = !owner.acquire(base + ".lock");
+		if (locked_out)
+			return false;
+		data = open_file(base + ".dat", "r+b");
+		if (!data)
+			data = open_file(base + ".dat", "w+b");
+		if (!data)
+			return false;
+		if (!map_index(initial_capacity)) {
+			close_files();
+			return false;
+		}
+		index_header* head = header();
+		if (memcmp(head->magic, index_magic, sizeof(index_magic)) != 0 || head->capacity == 0
+			|| sizeof(index_header) + head->capacity * sizeof(index_entry) > index.size()) {
+			//New or damaged index: start it again from the beginning of the data file
+			if (!reset_index(initial_capacity)) {
+				close_files();
+				return false;
+			}
+		}
+		else if (static_cast<long long>(head->data_end) > file_length(data)) {
+			//The data file was cut short or replaced under the index, which no longer says what is in it
+			if (!reset_index(head->capacity)) {
+				close_files();
+				return false;
+			}
+		}
+		recover();
+		return true;
+	}
+	void close() {
+		std::lock_guard<std::mutex> lock(guard);
+		close_files();
+	}
+	bool held() {
+		std::lock_guard<std::mutex> lock(guard);
+		return locked_out;
+	}
+	bool load(const tile_key& key, tile& out) {
+		stored_key wanted = store_key(key);
+		std::vector<unsigned char> packed;
+		{
+			std::lock_guard<std::mutex> lock(guard);
+			if (!data)
+				return false;
+			index_entry* entry = find(wanted);
+			if (!entry->used || !read_record(*entry))
+				return false;
+			packed.resize(entry->length);
+			if (entry->length && fread(&packed[0], 1, entry->length, data) != entry->length)
+				return false;
+		}
+		return unpack_tile(packed.empty() ? NULL : &packed[0], packed.size(), out);
+	}
+	void save(const tile_key& key, const tile& value) {
+		std::string packed = pack_tile(value);
+		record_header record;
+		memcpy(record.magic, record_magic, sizeof(record_magic));
+		record.length = static_cast<std::uint32_t>(packed.size());
+		record.key = store_key(key);
+		std::lock_guard<std::mutex> lock(guard);
+		//An entry whose record cannot be read back is written again and pointed at the new record
+		if (!data || (find(record.key)->used && read_record(*find(record.key))))
+			return;
+		std::uint64_t offset = header()->data_end;
+		if (!seek_file(data, static_cast<long long>(offset)) || fwrite(&record, sizeof(record), 1, data) != 1
+			|| fwrite(packed.data(), 1, packed.size(), data) != packed.size() || fflush(data) != 0)
+			return;
+		add(record.key, offset, record.length);
+		header()->data_end = offset + sizeof(record) + packed.size();
+	}
+	//Number of tiles in the store
+	long long size() {
+		std::lock_guard<std::mutex> lock(guard);
+		return index.data() ? static_cast<long long>(header()->count) : 0;
+	}
+private:
+	static const std::uint64_t initial_capacity = 4096;
+	// REPRESENTATION
+	std::string base;
+	file_lock owner;
+	bool locked_out;
+	FILE* data;
+	mapped_file index;
+	std::mutex guard;
+	index_header* header() { return reinterpret_cast<index_header*>(index.data()); }
+	index_entry* entries() { return reinterpret_cast<index_entry*>(index.data() + sizeof(index_header)); }
+	void close_files() {
+		index.close();
+		if (data)
+			fclose(data);
+		data = NULL;
+		owner.release();
+	}
+	bool map_index(std::uint64_t capacity) {
+		return index.open(base + ".idx", static_cast<std::size_t>(sizeof(index_header) + capacity * sizeof(index_entry)));
+	}
+	//Empty the index at the given capacity; it then covers none of the data file
+	bool reset_index(std::uint64_t capacity) {
+		if (!map_index(capacity))
+			return false;
+		memset(index.data(), 0, index.size());
+		index_header* head = header();
+		head->capacity = (index.size() - sizeof(index_header)) / sizeof(index_entry);
+		memcpy(head->magic, index_magic, sizeof(index_magic));
+		return true;
+	}
+	//The entry holding key, or the empty slot where it would go
+	index_entry* find(const stored_key& key) {
+		std::uint64_t capacity = header()->capacity;
+		index_entry* table = entries();
+		for (std::uint64_t k = stored_key_hash(key) % capacity;; k = (k + 1) % capacity)
+			if (!table[k].used || memcmp(&table[k].key, &key, sizeof(key)) == 0)
+				return &table[k];
+	}
+	void add(const stored_key& key, std::uint64_t offset, std::uint32_t length) {
+		if ((header()->count + 1) * 2 > header()->capacity && !grow())
+			return;
+		index_entry* entry = find(key);
+		header()->count += !entry->used;
+		entry->key = key;
+		entry->offset = offset;
+		entry->length = length;
+		entry->used = 1;
+	}
+	//Read the header of the record entry points at, leaving the data file at its packed tile; false if it is not
+	//there or is not the entry's
+	bool read_record(const index_entry& entry) {
+		record_header record;
+		return seek_file(data, static_cast<long long>(entry.offset)) && fread(&record, sizeof(record), 1, data) == 1
+			&& memcmp(record.magic, record_magic, sizeof(record_magic)) == 0 && memcmp(&record.key, &entry.key, sizeof(entry.key)) == 0
+			&& record.length == entry.length;
+	}
+	//Double the table. The magic is cleared while entries are moved, so a crash part way leaves an index
+	//that the next open recognises as damaged and rebuilds.
+	bool grow() {
+		std::vector<index_entry> kept;
+		index_entry* table = entries();
+		for (std::uint64_t k = 0; k < header()->capacity; ++k)
+			if (table[k].used)
+				kept.push_back(table[k]);
+		std::uint64_t capacity = header()->capacity * 2, data_end = header()->data_end;
+		memset(header()->magic, 0, sizeof(header()->magic));
+		if (!reset_index(capacity))
+			return false;
+		memset(header()->magic, 0, sizeof(header()->magic));
+		for (std::size_t k = 0; k < kept.size(); ++k) {
+			*find(kept[k].key) = kept[k];
+			++header()->count;
+		}
+		header()->data_end = data_end;
+		memcpy(header()->magic, index_magic, sizeof(index_magic));
+		return true;
+	}
+	//Index every whole record past data_end; anything after the last whole record was a torn write and will
+	//be overwritten by the next save
+	void recover() {
+		long long length = file_length(data);
+		std::uint64_t offset = header()->data_end;
+		record_header record;
+		while (static_cast<long long>(offset + sizeof(record)) <= length) {
+			if (!seek_file(data, static_cast<long long>(offset)) || fread(&record, sizeof(record), 1, data) != 1
+				|| memcmp(record.magic, record_magic, sizeof(record_magic)) != 0
+				|| static_cast<long long>(offset + sizeof(record) + record.length) > length)
+				break;
+			add(record.key, offset, record.length);
+			offset += sizeof(record) + record.length;
+			header()->data_end = offset;
+		}
+	}
+};
+
+#endif
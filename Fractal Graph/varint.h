@@ -0,0 +1,50 @@
+#pragma once
+//Varint coding of iteration values, shared by the tile store, view history and session snapshots
+#ifndef __VARINT_H__
+#define __VARINT_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+void put_varint(std::string& out, std::uint64_t value) {
+	while (value >= 0x80) {
+		out += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+bool get_varint(const unsigned char*& pos, const unsigned char* end, std::uint64_t& value) {
+	value = 0;
+	for (int shift = 0; pos < end && shift < 64; shift += 7) {
+		unsigned char byte = *pos++;
+		value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+//Neighbouring pixels are close, so iteration values compress well as varint differences from the one before
+void compress_iterations(const int* values, std::size_t count, std::string& out) {
+	std::int64_t previous = 0;
+	for (std::size_t p = 0; p < count; ++p) {
+		std::int64_t delta = values[p] - previous;
+		put_varint(out, (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+		previous = values[p];
+	}
+}
+
+bool expand_iterations(const unsigned char*& pos, const unsigned char* end, int* values, std::size_t count) {
+	std::int64_t previous = 0;
+	std::uint64_t value;
+	for (std::size_t p = 0; p < count; ++p) {
+		if (!get_varint(pos, end, value))
+			return false;
+		previous += static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+		values[p] = static_cast<int>(previous);
+	}
+	return true;
+}
+
+#endif